@@ -0,0 +1,114 @@
+#!/bin/sh
+# Scaling sweep of the headless driver over charge and thread counts.
+# Every configuration is run RUNS times. Prints the median over the runs
+# of the mean time of each phase and of the peak RSS, then the spread of
+# the times (slowest minus fastest run), and fails if a phase got slower
+# than bench/baseline.txt by more than THRESHOLD and by more than the
+# noise: the spreads of the baseline and of this sweep, and at least MIN_MS.
+#
+# Usage: bench/scaling.sh [--update-baseline]
+# Environment: CHARGES, THREADS, FRAMES, RUNS, DIRECT_MAX, THRESHOLD, MIN_MS, BASELINE
+set -e
+cd "$(dirname "$0")/.."
+
+CHARGES=${CHARGES:-"10 100 1000 10000 100000 1000000"}
+FRAMES=${FRAMES:-3}
+RUNS=${RUNS:-5}
+# Pairwise forces and field are quadratic, larger runs use the particle-mesh backend
+DIRECT_MAX=${DIRECT_MAX:-10000}
+THRESHOLD=${THRESHOLD:-0.25}
+MIN_MS=${MIN_MS:-1}
+BASELINE=${BASELINE:-bench/baseline.txt}
+
+if [ -z "$THREADS" ]; then
+    cores=$(nproc 2>/dev/null || sysctl -n hw.ncpu)
+    THREADS=1
+    t=2
+    while [ "$t" -lt "$cores" ]; do
+        THREADS="$THREADS $t"
+        t=$((t * 2))
+    done
+    [ "$cores" -gt 1 ] && THREADS="$THREADS $cores"
+fi
+
+make -s clean
+make -s headless SANITIZE=
+
+results=$(mktemp)
+runs=$(mktemp)
+trap 'rm -f "$results" "$runs"' EXIT
+echo "# charges threads backend update_ms lines_ms render_ms peak_rss_kb update_spread lines_spread render_spread" >"$results"
+for n in $CHARGES; do
+    backend=direct
+    [ "$n" -gt "$DIRECT_MAX" ] && backend=pic
+    for t in $THREADS; do
+        : >"$runs"
+        r=0
+        while [ "$r" -lt "$RUNS" ]; do
+            OMP_NUM_THREADS=$t ./headless --charges "$n" --frames "$FRAMES" --backend "$backend" |
+                awk -v t="$t" '{ print $2, t, $4, $6, $8, $10, $12 }' >>"$runs"
+            r=$((r + 1))
+        done
+        # Median and spread of every column over the runs
+        awk '
+            { for (i = 4; i <= 7; i++) v[i, NR] = $i; key = $1 " " $2 " " $3 }
+            END {
+                line = key
+                for (i = 4; i <= 7; i++) {
+                    for (a = 2; a <= NR; a++)
+                        for (b = a; b > 1 && v[i, b - 1] > v[i, b]; b--) {
+                            x = v[i, b]; v[i, b] = v[i, b - 1]; v[i, b - 1] = x
+                        }
+                    median[i] = NR % 2 ? v[i, (NR + 1) / 2] : (v[i, NR / 2] + v[i, NR / 2 + 1]) / 2
+                    spread[i] = v[i, NR] - v[i, 1]
+                    line = line " " median[i]
+                }
+                for (i = 4; i <= 6; i++)
+                    line = line " " sprintf("%.3f", spread[i])
+                print line
+            }
+        ' "$runs" >>"$results"
+    done
+done
+column -t "$results" 2>/dev/null || cat "$results"
+
+if [ "$1" = "--update-baseline" ]; then
+    {
+        echo "# Reference of bench/scaling.sh, regenerate with --update-baseline on the machine running the gate"
+        echo "# $(uname -sm), $(nproc 2>/dev/null || sysctl -n hw.ncpu) cores, $FRAMES frames per run, median of $RUNS runs"
+        cat "$results"
+    } >"$BASELINE"
+    echo "Baseline written to $BASELINE"
+    exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+    echo "No baseline at $BASELINE, run with --update-baseline to create it"
+    exit 0
+fi
+
+# Runs are matched on charges, threads and backend, runs absent from the
+# baseline are not compared. A baseline without spreads counts as noiseless.
+awk -v threshold="$THRESHOLD" -v min_ms="$MIN_MS" '
+    FNR == 1 { file++ }
+    /^#/ { next }
+    file == 1 { for (i = 4; i <= 10; i++) base[$1, $2, $3, i] = $i + 0; known[$1, $2, $3] = 1; next }
+    !(($1, $2, $3) in known) { next }
+    {
+        split("update_ms lines_ms render_ms peak_rss_kb", names, " ")
+        for (i = 4; i <= 7; i++) {
+            old = base[$1, $2, $3, i]
+            slack = 0
+            if (i < 7) {
+                slack = base[$1, $2, $3, i + 4] + $(i + 4)
+                slack = slack > min_ms ? slack : min_ms
+            }
+            if ($i > old * (1 + threshold) && $i - old > slack) {
+                printf "REGRESSION charges %s threads %s %s: %s -> %s\n", $1, $2, names[i - 3], old, $i
+                failed = 1
+            }
+        }
+    }
+    END { exit failed }
+' "$BASELINE" "$results" || exit 1
+echo "No phase regressed by more than $(awk -v t="$THRESHOLD" 'BEGIN { print t * 100 }')%"
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Domain decomposition over 1..8 local worker processes.
+# Every run steps the same charges, its first step is compared to
+# update_charges, and the check fails if the error or the imbalance of
+# the slabs goes over MAX_ERROR or MAX_IMBALANCE.
+#
+# Usage: bench/workers.sh
+# Environment: CHARGES, WORKERS, FRAMES, MAX_ERROR, MAX_IMBALANCE
+set -e
+cd "$(dirname "$0")/.."
+
+# At most the CHECK_MAX of headless.c, above it update_charges is not run
+CHARGES=${CHARGES:-20000}
+WORKERS=${WORKERS:-"1 2 4 8"}
+FRAMES=${FRAMES:-3}
+MAX_ERROR=${MAX_ERROR:-1e-3}
+MAX_IMBALANCE=${MAX_IMBALANCE:-1.5}
+
+make -s clean
+make -s headless SANITIZE=
+
+failed=0
+for w in $WORKERS; do
+    ./headless --charges "$CHARGES" --frames "$FRAMES" --workers "$w" |
+        awk -v max_error="$MAX_ERROR" -v max_imbalance="$MAX_IMBALANCE" '
+            { for (i = 1; i < NF; i += 2) value[$i] = $(i + 1) }
+            END {
+                printf "workers %s update_ms %s imbalance %s migrated %s step_error %s\n", value["workers"], value["update_ms"], value["imbalance"], value["migrated"], value["step_error"]
+                if (value["step_error"] == "" || value["step_error"] + 0 > max_error + 0) { print "FAILED step error"; exit 1 }
+                if (value["imbalance"] + 0 > max_imbalance + 0) { print "FAILED imbalance"; exit 1 }
+            }
+        ' || failed=1
+done
+exit $failed
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils/field_shm/field_shm.h"
+#include "utils/memory/memory.h"
+#include "utils/rng/rng.h"
+
+// Samples the field of a running main or headless started with
+// --publish NAME. Reads one "x y" point per line from the standard input
+// and prints "x y ex ey", or "x y -" where the field is unknown.
+// With --random M, times the query of M points spread over the view of
+// the engine instead.
+// --grid interpolates the published grid rather than summing the charges.
+
+static double seconds_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s NAME [--grid] [--random M]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    bool use_grid = false;
+    int num_random = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--grid") == 0)
+            use_grid = true;
+        else if (i + 1 < argc && strcmp(argv[i], "--random") == 0)
+            num_random = atoi(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    field_shm_client_t *client = field_shm_open(argv[1]);
+    if (!client)
+    {
+        fprintf(stderr, "No field published as %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    int num_points = 0, capacity = num_random > 0 ? num_random : 1024;
+    vec2 *points = mem_alloc(capacity * sizeof(vec2));
+    if (num_random > 0)
+    {
+        camera_t camera = client->header->camera;
+        rng_t rng = rng_create(1, RNG_STREAM_CHARGES, 0);
+        for (; num_points < num_random; num_points++)
+            points[num_points] = camera_to_world(&camera, rng_range(&rng, 0, camera.width), rng_range(&rng, 0, camera.height));
+    }
+    else
+    {
+        double x, y;
+        while (scanf("%lf %lf", &x, &y) == 2)
+        {
+            if (num_points == capacity)
+                points = mem_realloc(points, (capacity *= 2) * sizeof(vec2));
+            points[num_points++] = vec2_create(x, y);
+        }
+    }
+
+    vec2 *e = mem_alloc(num_points * sizeof(vec2));
+    bool *valid = mem_alloc(num_points * sizeof(bool));
+    uint64_t first_frame = client->header->frame;
+    double start = seconds_now();
+    bool answered = use_grid ? field_shm_sample_grid(client, points, num_points, e, valid) : field_shm_query(client, points, num_points, e, valid);
+    double seconds = seconds_now() - start;
+    if (!answered)
+    {
+        fprintf(stderr, "The engine kept writing, no consistent frame could be read\n");
+        return EXIT_FAILURE;
+    }
+
+    if (num_random > 0)
+    {
+        int known = 0;
+        for (int k = 0; k < num_points; k++)
+            known += valid[k];
+        printf("points %d known %d query_ms %.3f frames %llu..%llu retries %d\n", num_points, known, 1000 * seconds,
+               (unsigned long long)first_frame, (unsigned long long)client->frame, client->retries);
+    }
+    else
+        for (int k = 0; k < num_points; k++)
+        {
+            if (valid[k])
+                printf("%g %g %g %g\n", points[k].x, points[k].y, e[k].x, e[k].y);
+            else
+                printf("%g %g -\n", points[k].x, points[k].y);
+        }
+
+    mem_free(valid);
+    mem_free(e);
+    mem_free(points);
+    field_shm_close(client);
+    return EXIT_SUCCESS;
+}
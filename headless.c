@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "utils/charge/charge.h"
+#include "utils/gfx/gfx.h"
+#include "utils/vec2/vec2.h"
+#include "utils/field_lines/field_lines.h"
+#include "utils/seeding/seeding.h"
+#include "utils/memory/memory.h"
+#include "utils/rng/rng.h"
+#include "utils/camera/camera.h"
+#include "utils/charge_grid/charge_grid.h"
+#include "utils/pic/pic.h"
+#include "utils/p3m/p3m.h"
+#include "utils/dynamics/dynamics.h"
+#include "utils/density/density.h"
+#include "utils/reorder/reorder.h"
+#include "utils/perf/perf.h"
+#include "utils/domain/domain.h"
+#include "utils/field_shm/field_shm.h"
+
+// Runs the frame loop of main without a window, for timing: the charges
+// move, the field lines are traced and drawn in an offscreen frame.
+// Prints one line with the mean time of each phase and the peak RSS, and
+// the time of the sort when the charges are sorted along a curve first.
+// With --perf, a second line gives the hardware counters of each phase.
+// P3M runs, and all the runs in a periodic box, end with the tuning report.
+// With --workers, worker processes step the charges over slabs of the
+// plane, and for up to CHECK_MAX charges the first step is compared to
+// update_charges.
+// With --publish, the charges of every frame are published for field_query.
+
+#define SCREEN_WIDTH 1000
+#define SCREEN_HEIGHT 1000
+#define MESH_SIZE 256
+#define CHECK_MAX 20000
+
+typedef enum
+{
+    PHASE_UPDATE, // Forces and motion of the charges
+    PHASE_LINES,  // Tracing of the field lines
+    PHASE_RENDER, // Lines and charges drawn in the frame
+    PHASE_COUNT
+} phase_t;
+
+static const char *phase_names[PHASE_COUNT] = {"update", "lines", "render"};
+
+static double seconds_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--charges N] [--frames F] [--seed S] [--backend direct|pic|p3m] [--periodic] [--reorder none|morton|hilbert] [--perf] [--workers W] [--publish NAME]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int num_charges = 1000;
+    int frames = 5;
+    uint64_t seed = 1;
+    const char *backend = "direct";
+    bool periodic = false;
+    curve_t curve = CURVE_NONE;
+    bool use_perf = false;
+    int num_workers = 0;
+    const char *publish = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--charges") == 0)
+            num_charges = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--frames") == 0)
+            frames = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--backend") == 0)
+            backend = argv[++i];
+        else if (strcmp(argv[i], "--periodic") == 0)
+            periodic = true;
+        else if (i + 1 < argc && strcmp(argv[i], "--reorder") == 0)
+        {
+            i++;
+            curve = strcmp(argv[i], "morton") == 0 ? CURVE_MORTON : strcmp(argv[i], "hilbert") == 0 ? CURVE_HILBERT : CURVE_NONE;
+        }
+        else if (strcmp(argv[i], "--perf") == 0)
+            use_perf = true;
+        else if (i + 1 < argc && strcmp(argv[i], "--workers") == 0)
+            num_workers = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--publish") == 0)
+            publish = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    bool use_pic = strcmp(backend, "pic") == 0;
+    // The periodic box is summed by P3M
+    bool use_p3m = strcmp(backend, "p3m") == 0 || periodic;
+    if (num_charges < 1 || frames < 1 || num_workers < 0 || (!use_pic && !use_p3m && strcmp(backend, "direct") != 0))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Charges of +-1 spread uniformly, 30 pixels apart on average, and a
+    // camera showing all of them
+    double side = 30 * sqrt(num_charges);
+    charge_t *charges = mem_alloc(num_charges * sizeof(charge_t));
+    if (!charges)
+    {
+        fprintf(stderr, "Out of memory for %d charges\n", num_charges);
+        return EXIT_FAILURE;
+    }
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_charges; i++)
+    {
+        rng_t rng = rng_create(seed, RNG_STREAM_CHARGES, i);
+        double q = rng_next_u32(&rng) % 2 ? 1 : -1;
+        charges[i] = charge_create(q, vec2_create(rng_range(&rng, 0, side), rng_range(&rng, 0, side)));
+        charges[i].id = i;
+    }
+
+    camera_t camera = camera_create(SCREEN_WIDTH, SCREEN_HEIGHT);
+    camera.center = vec2_create(side / 2, side / 2);
+    camera.zoom = SCREEN_WIDTH / side;
+    double x0, x1, y0, y1;
+    camera_visible(&camera, &x0, &x1, &y0, &y1);
+    double pixel = 1 / camera.zoom;
+
+    struct gfx_context_t frame = {0};
+    frame.width = SCREEN_WIDTH;
+    frame.height = SCREEN_HEIGHT;
+    frame.pixels = mem_alloc(SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint32_t));
+
+    arena_t frame_arena;
+    arena_init(&frame_arena, 1 << 20);
+    field_lines_t *field_lines = field_lines_create(0.02);
+    charge_grid_t charge_grid;
+    charge_grid_init(&charge_grid);
+    density_buffer_t density;
+    density_init(&density, SCREEN_WIDTH, SCREEN_HEIGHT, 1.5, MAKE_COLOR(20, 20, 20));
+    dynamics_t dynamics = dynamics_create(INTEGRATOR_OVERDAMPED, 0.000001, seed);
+    dynamics.report_every = 0;
+    pic_t *force_mesh = pic_create(PIC_FORCE, PIC_OPEN, MESH_SIZE, MESH_SIZE);
+    pic_t *field_mesh = pic_create(PIC_FIELD, periodic ? PIC_PERIODIC : PIC_OPEN, MESH_SIZE, MESH_SIZE);
+    p3m_t *p3m = p3m_create(0.01);
+    p3m_set_periodic(p3m, periodic);
+    if (periodic)
+    {
+        // The box is the area the charges were spread over
+        p3m_set_box(p3m, 0, side, 0, side);
+        pic_set_box(field_mesh, 0, side, 0, side);
+    }
+
+    // Charges are created in random places, as clicks would, and sorted
+    // once: they move too little in a few frames to need it again
+    double sort_start = seconds_now();
+    reorder_charges(charges, num_charges, curve, &frame_arena, NULL);
+    double sort_seconds = seconds_now() - sort_start;
+
+    perf_t *perf = use_perf ? perf_create() : NULL;
+
+    field_shm_t *shm = NULL;
+    if (publish && !(shm = field_shm_create(publish)))
+    {
+        fprintf(stderr, "Could not publish the field as %s\n", publish);
+        return EXIT_FAILURE;
+    }
+
+    domain_t *domain = NULL;
+    charge_t *reference = NULL;
+    vec2 *origins = NULL;
+    double step_error = 0;
+    if (num_workers)
+    {
+        domain = domain_create(num_workers, num_charges);
+        if (!domain || !domain_load(domain, charges, num_charges))
+        {
+            fprintf(stderr, "Could not start %d workers\n", num_workers);
+            return EXIT_FAILURE;
+        }
+        // update_charges on a copy, laid out by id
+        if (num_charges <= CHECK_MAX)
+        {
+            reference = mem_alloc(num_charges * sizeof(charge_t));
+            origins = mem_alloc(num_charges * sizeof(vec2));
+            for (int i = 0; i < num_charges; i++)
+            {
+                reference[charges[i].id] = charges[i];
+                origins[charges[i].id] = charges[i].pos;
+            }
+            update_charges(reference, num_charges, dynamics.dt, &frame_arena);
+        }
+    }
+
+    double totals[PHASE_COUNT] = {0};
+    for (int f = 0; f < frames; f++)
+    {
+        arena_reset(&frame_arena);
+        gfx_clear(&frame, COLOR_WHITE);
+
+        double start = seconds_now();
+        perf_begin(perf, PERF_SECTION_UPDATE);
+        force_solver_t solver = NULL;
+        void *solver_data = NULL;
+        if (domain)
+        {
+            if (!domain_step(domain, dynamics.dt))
+            {
+                fprintf(stderr, "A worker died\n");
+                return EXIT_FAILURE;
+            }
+            domain_gather(domain, charges);
+        }
+        else if (use_p3m)
+        {
+            if (periodic)
+                p3m_wrap(p3m, charges, num_charges);
+            else
+                p3m_set_box(p3m, x0, x1, y0, y1);
+            solver = p3m_forces;
+            solver_data = p3m;
+        }
+        else if (use_pic)
+        {
+            pic_set_box(force_mesh, x0, x1, y0, y1);
+            solver = pic_forces;
+            solver_data = force_mesh;
+        }
+        if (!domain)
+            dynamics_step(&dynamics, solver, solver_data, &frame_arena, charges, num_charges);
+        perf_end(perf, PERF_SECTION_UPDATE);
+        double updated = seconds_now();
+
+        // RMS error of the displacements relative to their RMS
+        if (reference && f == 0)
+        {
+            double error = 0, norm = 0;
+            for (int i = 0; i < num_charges; i++)
+            {
+                uint32_t id = charges[i].id;
+                error += vec2_norm_sqr(vec2_sub(charges[i].pos, reference[id].pos));
+                norm += vec2_norm_sqr(vec2_sub(reference[id].pos, origins[id]));
+            }
+            step_error = sqrt(error / norm);
+        }
+
+        if (use_pic || periodic)
+        {
+            if (!periodic)
+                pic_set_box(field_mesh, x0, x1, y0, y1);
+            pic_solve(field_mesh, charges, num_charges);
+            field_lines_set_sampler(field_lines, pic_sample, field_mesh);
+        }
+        if (shm)
+            field_shm_publish(shm, charges, num_charges, &camera, NULL);
+
+        perf_begin(perf, PERF_SECTION_LINES);
+        int precision = 11;
+        field_seed_t *seeds = arena_alloc(&frame_arena, precision * precision * sizeof(field_seed_t));
+        int num_seeds = seeding_grid(precision, x0, x1, y0, y1, seeds);
+        field_lines_set_separation(field_lines, 0, 0.088 * pixel, 0);
+        field_lines_set_capture_radius(field_lines, 10 * pixel);
+        field_lines_set_seeds(field_lines, seeds, num_seeds);
+        field_lines_update(field_lines, &frame_arena, charges, num_charges, x0, x1, y0, y1);
+        perf_end(perf, PERF_SECTION_LINES);
+        double traced = seconds_now();
+
+        perf_begin(perf, PERF_SECTION_RENDER);
+        field_lines_draw(&density, &camera, field_lines);
+        density_tonemap(&frame, &density);
+        perf_end(perf, PERF_SECTION_RENDER);
+        charge_grid_build(&charge_grid, charges, num_charges, 64 * pixel);
+        int *visible = arena_alloc(&frame_arena, num_charges * sizeof(int));
+        int num_visible = charge_grid_query(&charge_grid, x0, x1, y0, y1, visible);
+        perf_begin(perf, PERF_SECTION_CHARGES);
+        draw_charges(&frame, &camera, charges, visible, num_visible);
+        perf_end(perf, PERF_SECTION_CHARGES);
+        perf_end_frame(perf);
+        double rendered = seconds_now();
+
+        totals[PHASE_UPDATE] += updated - start;
+        totals[PHASE_LINES] += traced - updated;
+        totals[PHASE_RENDER] += rendered - traced;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("charges %d backend %s", num_charges, periodic ? "periodic" : backend);
+    for (int p = 0; p < PHASE_COUNT; p++)
+        printf(" %s_ms %.3f", phase_names[p], 1000 * totals[p] / frames);
+    printf(" peak_rss_kb %ld", usage.ru_maxrss);
+    if (curve != CURVE_NONE)
+        printf(" reorder_ms %.3f", 1000 * sort_seconds);
+    if (domain)
+    {
+        printf(" workers %d imbalance %.3f migrated %ld rebalances %d", domain->num_workers, domain->imbalance, domain->migrated, domain->rebalances);
+        if (reference)
+            printf(" step_error %.2e", step_error);
+    }
+    printf("\n");
+    if (use_perf)
+    {
+        char counters[1024];
+        perf_format(perf, perf ? perf->total : NULL, frames, counters, sizeof(counters));
+        printf("perf per frame: %s\n", counters);
+    }
+
+    if (use_p3m)
+        p3m_print_report(p3m, stdout);
+
+    if (domain)
+        domain_destroy(domain);
+    if (shm)
+        field_shm_destroy(shm);
+    mem_free(reference);
+    mem_free(origins);
+    perf_destroy(perf);
+    p3m_destroy(p3m);
+    pic_destroy(force_mesh);
+    pic_destroy(field_mesh);
+    dynamics_free(&dynamics);
+    density_free(&density);
+    charge_grid_free(&charge_grid);
+    field_lines_destroy(field_lines);
+    arena_free(&frame_arena);
+    mem_free(frame.pixels);
+    mem_free(charges);
+    return EXIT_SUCCESS;
+}
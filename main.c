@@ -2,18 +2,74 @@
 #include <stdint.h>
 #include <time.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "utils/utils.h"
 #include "utils/charge/charge.h"
 #include "utils/gfx/gfx.h"
 #include "utils/vec2/vec2.h"
+#include "utils/field_lines/field_lines.h"
+#include "utils/seeding/seeding.h"
+#include "utils/memory/memory.h"
+#include "utils/rng/rng.h"
+#include "utils/camera/camera.h"
+#include "utils/charge_grid/charge_grid.h"
+#include "utils/conductor/conductor.h"
+#include "utils/pic/pic.h"
+#include "utils/p3m/p3m.h"
+#include "utils/dynamics/dynamics.h"
+#include "utils/density/density.h"
+#include "utils/field_grid/field_grid.h"
+#include "utils/lic/lic.h"
+#include "utils/quiver/quiver.h"
+#include "utils/reorder/reorder.h"
+#include "utils/perf/perf.h"
+#include "utils/field_shm/field_shm.h"
+#include "utils/interaction/interaction.h"
 
 #define SCREEN_WIDTH 1000
 #define SCREEN_HEIGHT 1000
+#define MAX_CHARGES 4096
+#define MESH_SIZE 256
+// Frames between two sorts of the charges along the space-filling curve
+#define REORDER_EVERY 64
 
-int main()
+// How the charges push each other
+typedef enum
 {
-    srand(time(NULL));
+    BACKEND_DIRECT, // Pairwise sums of update_charges
+    BACKEND_PIC,    // Particle-mesh, for very many charges
+    BACKEND_P3M,    // Particle-mesh with the close pairs summed directly
+    BACKEND_COUNT
+} backend_t;
+
+static const char *backend_names[BACKEND_COUNT] = {"", " (particle-mesh)", " (P3M)"};
+static const char *curve_names[CURVE_COUNT] = {"", ", Morton order", ", Hilbert order"};
+
+static int compare_ids(const void *a, const void *b)
+{
+    uint32_t x = ((const charge_t *)a)->id, y = ((const charge_t *)b)->id;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    // Every random number comes from this seed, pass --seed to replay a run
+    uint64_t seed = time(NULL);
+    bool use_perf = false;
+    const char *publish = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+            seed = strtoull(argv[i + 1], NULL, 10);
+        // Shared memory segment the field is published in for field_query
+        if (i + 1 < argc && strcmp(argv[i], "--publish") == 0)
+            publish = argv[i + 1];
+        // Hardware counters of the hot sections, shown in the title
+        use_perf |= strcmp(argv[i], "--perf") == 0;
+    }
+    printf("Seed: %llu\n", (unsigned long long)seed);
+
     struct gfx_context_t *ctxt = gfx_create("Zip Zap Zop", SCREEN_WIDTH, SCREEN_HEIGHT);
     if (!ctxt)
     {
@@ -21,19 +77,95 @@ int main()
         return EXIT_FAILURE;
     }
 
-    charge_t *charges = malloc(0 * sizeof(charge_t)); // Initially allocate memory for 2 charges
+    // Charges live in a fixed pool, and per-frame scratch data in an arena
+    // reset every frame, so that steady frames make no heap allocation
+    pool_t charge_pool;
+    pool_init(&charge_pool, sizeof(charge_t), MAX_CHARGES);
+    charge_t *charges = (charge_t *)charge_pool.items;
     int number_of_charges = 0;
 
+    arena_t frame_arena;
+    arena_init(&frame_arena, 1 << 20);
+
     int field_lines_array_precision = 11; // higher leads to worse performances to the square of the number
-    double vertical_unit = SCREEN_HEIGHT / field_lines_array_precision;
-    double horizontal_unit = SCREEN_WIDTH / field_lines_array_precision;
+    double lines_per_unit_charge = 8;
+    bool seeding_is_flux = true;
+
+    // Lines are only retraced when an edit changes the field near them by more than 2%
+    field_lines_t *field_lines = field_lines_create(0.02);
+
+    // The world is explored through a camera; sizes below are in pixels and
+    // divided by the zoom, so that the level of detail follows the zoom
+    camera_t camera = camera_create(SCREEN_WIDTH, SCREEN_HEIGHT);
+    charge_grid_t charge_grid;
+    charge_grid_init(&charge_grid);
+
+    // Field lines add up in a density buffer, a single line is light grey
+    // and bundles of lines darken towards the ink
+    density_buffer_t density;
+    density_init(&density, SCREEN_WIDTH, SCREEN_HEIGHT, 1.5, MAKE_COLOR(20, 20, 20));
+
+    // The LIC view replaces the lines by noise smeared along the field,
+    // sampled every 2 pixels
+    field_grid_t field_grid;
+    field_grid_init(&field_grid);
+    lic_t lic;
+    lic_init(&lic, SCREEN_WIDTH, SCREEN_HEIGHT, seed);
+    bool mode_is_lic = false;
+
+    // The quiver view draws an arrow every 16 pixels instead, sampled on
+    // the same grid
+    quiver_t quiver;
+    quiver_init(&quiver, 16);
+    bool mode_is_quiver = false;
+
+    // Charges can be kept sorted along a space-filling curve, so that the
+    // grids and meshes walk them in memory order. Ids follow the charges.
+    curve_t curve = CURVE_NONE;
+    uint32_t next_id = 0;
+
+    // Conductors are held at a fixed potential by charges induced on their panels
+    conductors_t *conductors = conductors_create(8);
+    bool mode_is_conductor = false;
+
+    // In particle-mesh mode, forces and field lines both come from meshes
+    // with open boundaries, fitted over the view and the charges
+    backend_t backend = BACKEND_DIRECT;
+    // Law of the pairwise forces, its lengths follow the zoom
+    interaction_t interaction = interaction_create(LAW_COULOMB, 0);
+    pic_t *force_mesh = pic_create(PIC_FORCE, PIC_OPEN, MESH_SIZE, MESH_SIZE);
+    pic_t *field_mesh = pic_create(PIC_FIELD, PIC_OPEN, MESH_SIZE, MESH_SIZE);
+    // P3M tunes its mesh and cutoff for a 1% force error
+    p3m_t *p3m = p3m_create(0.01);
+    // In a periodic box, the screen area at start repeats without end.
+    // Forces come from P3M summing all the images, the field lines from a
+    // periodic mesh so that they go on across the edges.
+    bool box_is_periodic = false;
+    pic_t *box_field_mesh = pic_create(PIC_FIELD, PIC_PERIODIC, MESH_SIZE, MESH_SIZE);
+    pic_set_box(box_field_mesh, 0, SCREEN_WIDTH, 0, SCREEN_HEIGHT);
+    int reported_tunings = 0;
+
+    // Charges drift along the force by default, or have inertia with a
+    // light damping. A step moving a charge by more than 20 pixels is taken
+    // again with a smaller dt.
+    dynamics_t dynamics = dynamics_create(INTEGRATOR_OVERDAMPED, 0.000001, seed);
+
+    int frame = 0;
+    uint64_t clicks = 0;
+    long reported_allocations = mem_allocation_count();
+    char title[1024];
+    perf_t *perf = NULL;
+    if (use_perf && !(perf = perf_create()))
+        fprintf(stderr, "No performance counter could be opened, running without them\n");
+    field_shm_t *shm = NULL;
+    if (publish && !(shm = field_shm_create(publish)))
+        fprintf(stderr, "Could not publish the field as %s, running without it\n", publish);
 
     bool mode_is_negative = true;
 
     SDL_Keycode pressedKey;
 
-    int *x = malloc(sizeof(int));
-    int *y = malloc(sizeof(int));
+    int x, y;
 
     bool is_paused = true;
 
@@ -41,8 +173,9 @@ int main()
     {
         gfx_present(ctxt);
         gfx_clear(ctxt, COLOR_WHITE);
+        arena_reset(&frame_arena);
 
-        pressedKey = gfx_keypressed(x, y);
+        pressedKey = gfx_keypressed(&x, &y);
 
         if (pressedKey == 27)
         { // Assuming 27 is the key code for Escape
@@ -58,47 +191,311 @@ int main()
                 case SDLK_s:
                     mode_is_negative = !mode_is_negative;
                     break;
+                case SDLK_c:
+                    mode_is_conductor = !mode_is_conductor;
+                    break;
+                case SDLK_p:
+                    backend = (backend + 1) % BACKEND_COUNT;
+                    break;
+                case SDLK_i:
+                    dynamics.integrator = dynamics.integrator == INTEGRATOR_OVERDAMPED ? INTEGRATOR_INERTIAL : INTEGRATOR_OVERDAMPED;
+                    dynamics.max_dt = dynamics.integrator == INTEGRATOR_INERTIAL ? 0.001 : 0.000001;
+                    dynamics.damping = dynamics.integrator == INTEGRATOR_INERTIAL ? 2 : 0;
+                    for (int i = 0; i < number_of_charges; i++)
+                        charges[i].vel = vec2_create(0, 0);
+                    dynamics_reset(&dynamics);
+                    break;
+                case SDLK_b:
+                    box_is_periodic = !box_is_periodic;
+                    p3m_set_periodic(p3m, box_is_periodic);
+                    dynamics_reset(&dynamics);
+                    break;
+                case SDLK_f:
+                    interaction.law = (interaction.law + 1) % LAW_COUNT;
+                    break;
+                case SDLK_o:
+                    curve = (curve + 1) % CURVE_COUNT;
+                    break;
+                case SDLK_l:
+                    mode_is_lic = !mode_is_lic;
+                    mode_is_quiver = false;
+                    break;
+                case SDLK_v:
+                    mode_is_quiver = !mode_is_quiver;
+                    mode_is_lic = false;
+                    break;
+                case SDLK_g:
+                    seeding_is_flux = !seeding_is_flux;
+                    break;
                 case SDLK_SPACE:
                     is_paused = !is_paused;
                     break;
+                case SDLK_LEFT:
+                    camera_pan(&camera, -SCREEN_WIDTH / 10, 0);
+                    break;
+                case SDLK_RIGHT:
+                    camera_pan(&camera, SCREEN_WIDTH / 10, 0);
+                    break;
+                case SDLK_UP:
+                    camera_pan(&camera, 0, -SCREEN_HEIGHT / 10);
+                    break;
+                case SDLK_DOWN:
+                    camera_pan(&camera, 0, SCREEN_HEIGHT / 10);
+                    break;
+                // Keyboard zooms around the middle, the wheel around the mouse
+                case SDLK_PLUS:
+                case SDLK_EQUALS:
+                    camera_zoom_at(&camera, 1.25, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+                    break;
+                case SDLK_MINUS:
+                    camera_zoom_at(&camera, 1 / 1.25, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+                    break;
+                case GFX_WHEEL_UP:
+                    camera_zoom_at(&camera, 1.25, x, y);
+                    break;
+                case GFX_WHEEL_DOWN:
+                    camera_zoom_at(&camera, 1 / 1.25, x, y);
+                    break;
                 case SDLK_r:
 
                     number_of_charges = 0;
-                    charges = realloc(charges, 0 * sizeof(charge_t));
+                    next_id = 0;
+                    pool_reset(&charge_pool);
+                    conductors_clear(conductors);
+                    dynamics_reset(&dynamics);
                     break;
 
-                case SDL_MOUSEBUTTONDOWN:
-                    charges = realloc(charges, (number_of_charges + 1) * sizeof(charge_t));
+                case SDL_MOUSEBUTTONDOWN:;
+                    if (mode_is_conductor)
+                    {
+                        // About the potential a unit charge makes 50 pixels away
+                        double potential = (mode_is_negative ? 4 : -4) * K;
+                        conductors_add_circle(conductors, camera_to_world(&camera, x, y), 40 / camera.zoom, potential);
+                        break;
+                    }
+                    charge_t *charge = pool_alloc(&charge_pool);
+                    if (!charge)
+                    {
+                        fprintf(stderr, "Cannot add more than %d charges\n", MAX_CHARGES);
+                        break;
+                    }
 
+                    rng_t rng = rng_create(seed, RNG_STREAM_CHARGES, clicks++);
                     double charge_value = mode_is_negative ? 1 : -1;
-                    charge_value = charge_value * (rand() % 2 + 1);
+                    charge_value = charge_value * (rng_next_u32(&rng) % 2 + 1);
 
-                    charges[number_of_charges] = charge_create(charge_value, vec2_create(*x, *y));
+                    *charge = charge_create(charge_value, camera_to_world(&camera, x, y));
+                    charge->id = next_id++;
                     number_of_charges++;
                     break;
                 }
             }
         }
 
+        if (curve != CURVE_NONE && frame % REORDER_EVERY == 0)
+        {
+            int *order = arena_alloc(&frame_arena, number_of_charges * sizeof(int));
+            reorder_charges(charges, number_of_charges, curve, &frame_arena, order);
+            dynamics_permute(&dynamics, order, number_of_charges, &frame_arena);
+            field_lines_permute(field_lines, order, number_of_charges, &frame_arena);
+        }
+
+        double x0, x1, y0, y1;
+        camera_visible(&camera, &x0, &x1, &y0, &y1);
+
         if (is_paused)
         {
-            // Add fluctuation to the charges
+            // Add fluctuation to the charges, drawn from the frame and charge
+            // id only so that any thread can draw any charge, in any order
+#pragma omp parallel for schedule(static)
             for (int i = 0; i < number_of_charges; i++)
             {
-                charges[i].q += ((rand() % 2000) - 1000.0) / 1000000.0;
+                rng_t rng = rng_create(seed, RNG_STREAM_JITTER, (uint64_t)frame << 32 | charges[i].id);
+                charges[i].q += ((int)(rng_next_u32(&rng) % 2000) - 1000.0) / 1000000.0;
             }
         }
         else
         {
-            update_charges(charges, number_of_charges, 0.000001);
+            interaction.softening = 10 / camera.zoom;
+            interaction.cutoff = 200 / camera.zoom;
+            interaction.screening = 200 / camera.zoom;
+            force_solver_t solver = interaction_forces;
+            void *solver_data = &interaction;
+            if (box_is_periodic || backend == BACKEND_P3M)
+            {
+                if (box_is_periodic)
+                    p3m_set_box(p3m, 0, SCREEN_WIDTH, 0, SCREEN_HEIGHT);
+                else
+                    p3m_set_box(p3m, x0, x1, y0, y1);
+                solver = p3m_forces;
+                solver_data = p3m;
+            }
+            else if (backend == BACKEND_PIC)
+            {
+                pic_set_box(force_mesh, x0, x1, y0, y1);
+                solver = pic_forces;
+                solver_data = force_mesh;
+            }
+            if (box_is_periodic)
+                p3m_wrap(p3m, charges, number_of_charges);
+            dynamics.max_displacement = 20 / camera.zoom;
+            perf_begin(perf, PERF_SECTION_UPDATE);
+            bool stepped = dynamics_step(&dynamics, solver, solver_data, &frame_arena, charges, number_of_charges);
+            perf_end(perf, PERF_SECTION_UPDATE);
+            if (!stepped)
+            {
+                printf("The simulation diverged at step %ld, pausing\n", dynamics.step);
+                is_paused = true;
+                dynamics_reset(&dynamics);
+            }
+            if (p3m->tunings != reported_tunings)
+            {
+                p3m_print_report(p3m, stdout);
+                reported_tunings = p3m->tunings;
+            }
+        }
+
+        // The field comes from the charges followed by the ones induced on the conductors
+        conductors_solve(conductors, &frame_arena, charges, number_of_charges);
+        int num_sources = number_of_charges + conductors->num_induced;
+        charge_t *sources = arena_alloc(&frame_arena, num_sources * sizeof(charge_t));
+        memcpy(sources, charges, number_of_charges * sizeof(charge_t));
+        memcpy(sources + number_of_charges, conductors->induced, conductors->num_induced * sizeof(charge_t));
+
+        field_sampler_t sampler = NULL;
+        void *sampler_data = NULL;
+        if (box_is_periodic)
+        {
+            pic_solve(box_field_mesh, sources, num_sources);
+            sampler = pic_sample;
+            sampler_data = box_field_mesh;
+        }
+        else if (backend == BACKEND_PIC)
+        {
+            pic_set_box(field_mesh, x0, x1, y0, y1);
+            pic_solve(field_mesh, sources, num_sources);
+            sampler = pic_sample;
+            sampler_data = field_mesh;
         }
+        field_lines_set_sampler(field_lines, sampler, sampler_data);
 
         // DRAW
-        for (int y = 0; y < field_lines_array_precision; y++)
-            for (int x = 0; x < field_lines_array_precision; x++)
-                draw_field_lines(ctxt, charges, number_of_charges, 0.088, vec2_create(horizontal_unit * x, vertical_unit * y), 0, SCREEN_WIDTH, 0, SCREEN_HEIGHT);
+        double pixel = 1 / camera.zoom;
+        charge_grid_build(&charge_grid, charges, number_of_charges, 64 * pixel);
 
-        draw_charges(ctxt, charges, number_of_charges, 0, SCREEN_WIDTH, 0, SCREEN_HEIGHT);
+        int num_seeds = 0;
+        field_seed_t *seeds = NULL;
+        if (mode_is_lic)
+        {
+            field_grid_update(&field_grid, &camera, 2, sources, num_sources, sampler, sampler_data);
+            perf_begin(perf, PERF_SECTION_RENDER);
+            lic_render(ctxt, &lic, &field_grid);
+            perf_end(perf, PERF_SECTION_RENDER);
+        }
+        else if (mode_is_quiver)
+        {
+            field_grid_update(&field_grid, &camera, quiver.spacing, sources, num_sources, sampler, sampler_data);
+            perf_begin(perf, PERF_SECTION_RENDER);
+            quiver_render(ctxt, &quiver, &field_grid);
+            perf_end(perf, PERF_SECTION_RENDER);
+        }
+        else if (seeding_is_flux)
+        {
+            // Only charges in view seed lines, in proportion to their flux.
+            // A coarse grid after them catches the lines coming from charges
+            // out of view. Lines stop when they come closer than 20 pixels
+            // to another one.
+            int *near = arena_alloc(&frame_arena, number_of_charges * sizeof(int));
+            int num_near = charge_grid_query(&charge_grid, x0, x1, y0, y1, near);
+            // Seeds keep the order of the ids so that cached lines are found
+            // again, even after a reordering
+            charge_t *near_charges = arena_alloc(&frame_arena, num_near * sizeof(charge_t));
+            for (int i = 0; i < num_near; i++)
+                near_charges[i] = charges[near[i]];
+            qsort(near_charges, num_near, sizeof(charge_t), compare_ids);
+
+            int num_fill = 5;
+            seeds = arena_alloc(&frame_arena, (seeding_flux_count(near_charges, num_near, lines_per_unit_charge) + num_fill * num_fill) * sizeof(field_seed_t));
+            field_lines_set_separation(field_lines, 20 * pixel, 0.088 * pixel, 4000);
+            num_seeds = seeding_flux(near_charges, num_near, lines_per_unit_charge, 12 * pixel, 0.088 * pixel, seeds);
+            num_seeds += seeding_grid(num_fill, x0, x1, y0, y1, seeds + num_seeds);
+        }
+        else
+        {
+            seeds = arena_alloc(&frame_arena, field_lines_array_precision * field_lines_array_precision * sizeof(field_seed_t));
+            field_lines_set_separation(field_lines, 0, 0.088 * pixel, 0);
+            num_seeds = seeding_grid(field_lines_array_precision, x0, x1, y0, y1, seeds);
+        }
+        if (!mode_is_lic && !mode_is_quiver)
+        {
+            // Lines end on the drawn outline of the charges
+            field_lines_set_capture_radius(field_lines, 10 * pixel);
+            field_lines_set_seeds(field_lines, seeds, num_seeds);
+            perf_begin(perf, PERF_SECTION_LINES);
+            field_lines_update(field_lines, &frame_arena, sources, num_sources, x0, x1, y0, y1);
+            perf_end(perf, PERF_SECTION_LINES);
+            perf_begin(perf, PERF_SECTION_RENDER);
+            field_lines_draw(&density, &camera, field_lines);
+            density_tonemap(ctxt, &density);
+            perf_end(perf, PERF_SECTION_RENDER);
+        }
+        // The grid only exists in the LIC and quiver modes
+        if (shm)
+            field_shm_publish(shm, sources, num_sources, &camera, mode_is_lic || mode_is_quiver ? &field_grid : NULL);
+        draw_conductors(ctxt, &camera, conductors);
+        if (box_is_periodic)
+        {
+            coordinates_t corner0 = camera_to_screen(&camera, vec2_create(0, 0));
+            coordinates_t corner1 = camera_to_screen(&camera, vec2_create(SCREEN_WIDTH, SCREEN_HEIGHT));
+            draw_line(ctxt, corner0.column, corner0.row, corner1.column, corner0.row, MAKE_COLOR(120, 120, 120));
+            draw_line(ctxt, corner1.column, corner0.row, corner1.column, corner1.row, MAKE_COLOR(120, 120, 120));
+            draw_line(ctxt, corner1.column, corner1.row, corner0.column, corner1.row, MAKE_COLOR(120, 120, 120));
+            draw_line(ctxt, corner0.column, corner1.row, corner0.column, corner0.row, MAKE_COLOR(120, 120, 120));
+        }
+
+        if (frame++ % 30 == 0)
+        {
+            trace_stats_t *stats = &field_lines->stats;
+            snprintf(title, sizeof(title), "Zip Zap Zop%s%s%s%s - %d lines, %d retraced, %ld steps, %ld saved (captured %d, stagnated %d, looped %d), %ld allocations in 30 frames, energy %.3g (kinetic %.3g), dt %.2g",
+                     box_is_periodic ? " (periodic P3M)" : backend_names[backend], box_is_periodic ? "" : backend == BACKEND_DIRECT ? ", " : "", !box_is_periodic && backend == BACKEND_DIRECT ? force_law_names[interaction.law] : "",
+                     curve_names[curve], field_lines->num_lines, field_lines->retraced, stats->steps, stats->saved,
+                     stats->stops[STOP_CAPTURED], stats->stops[STOP_STAGNATED], stats->stops[STOP_LOOPED],
+                     mem_allocation_count() - reported_allocations,
+                     dynamics.report.total, dynamics.report.kinetic, dynamics.dt);
+            if (perf)
+            {
+                // Counters of the last complete frame
+                int length = strlen(title);
+                length += snprintf(title + length, sizeof(title) - length, " | ");
+                perf_format(perf, perf->last, 1, title + length, sizeof(title) - length);
+            }
+            gfx_set_title(ctxt, title);
+            reported_allocations = mem_allocation_count();
+        }
+
+        int *visible = arena_alloc(&frame_arena, number_of_charges * sizeof(int));
+        int num_visible = charge_grid_query(&charge_grid, x0 - 11 * pixel, x1 + 11 * pixel, y0 - 11 * pixel, y1 + 11 * pixel, visible);
+        perf_begin(perf, PERF_SECTION_CHARGES);
+        draw_charges(ctxt, &camera, charges, visible, num_visible);
+        if (box_is_periodic)
+        {
+            // The images of the charges in the neighbouring boxes, drawn by
+            // moving the camera the other way
+            for (int sy = -1; sy <= 1; sy++)
+                for (int sx = -1; sx <= 1; sx++)
+                {
+                    if (sx == 0 && sy == 0)
+                        continue;
+                    vec2 shift = vec2_create(sx * SCREEN_WIDTH, sy * SCREEN_HEIGHT);
+                    camera_t image = camera;
+                    image.center = vec2_sub(camera.center, shift);
+                    num_visible = charge_grid_query(&charge_grid, x0 - shift.x - 11 * pixel, x1 - shift.x + 11 * pixel,
+                                                    y0 - shift.y - 11 * pixel, y1 - shift.y + 11 * pixel, visible);
+                    draw_charges(ctxt, &image, charges, visible, num_visible);
+                }
+        }
+        perf_end(perf, PERF_SECTION_CHARGES);
+        perf_end_frame(perf);
 
         // draw circle on top right according to the mode
         draw_full_circle(ctxt, SCREEN_WIDTH - 20, 20, 10, mode_is_negative ? MAKE_COLOR(0, 0, 255) : MAKE_COLOR(255, 0, 0));
@@ -113,7 +510,23 @@ int main()
         }
     }
 
-    free(charges); // Don't forget to free the dynamically allocated memory
+    pool_free(&charge_pool); // Don't forget to free the dynamically allocated memory
+    arena_free(&frame_arena);
+    field_lines_destroy(field_lines);
+    conductors_destroy(conductors);
+    pic_destroy(force_mesh);
+    pic_destroy(field_mesh);
+    pic_destroy(box_field_mesh);
+    p3m_destroy(p3m);
+    dynamics_free(&dynamics);
+    charge_grid_free(&charge_grid);
+    density_free(&density);
+    field_grid_free(&field_grid);
+    lic_free(&lic);
+    quiver_free(&quiver);
+    perf_destroy(perf);
+    if (shm)
+        field_shm_destroy(shm);
     gfx_destroy(ctxt);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,62 @@
+#include "camera.h"
+#include "../utils.h"
+
+#define MIN_ZOOM 1e-4
+#define MAX_ZOOM 1e4
+
+// A camera showing the world [0,width]x[0,height] pixel for pixel
+camera_t camera_create(int width, int height)
+{
+    camera_t camera = {.center = vec2_create(width / 2.0, height / 2.0), .zoom = 1, .width = width, .height = height};
+    return camera;
+}
+
+// The part of the world [x0,x1]x[y0,y1] shown on the screen
+void camera_visible(camera_t *camera, double *x0, double *x1, double *y0, double *y1)
+{
+    double half_width = camera->width / (2 * camera->zoom);
+    double half_height = camera->height / (2 * camera->zoom);
+    *x0 = camera->center.x - half_width;
+    *x1 = camera->center.x + half_width;
+    *y0 = camera->center.y - half_height;
+    *y1 = camera->center.y + half_height;
+}
+
+coordinates_t camera_to_screen(camera_t *camera, vec2 pos)
+{
+    double x0, x1, y0, y1;
+    camera_visible(camera, &x0, &x1, &y0, &y1);
+    return position_to_coordinates(camera->width, camera->height, x0, x1, y0, y1, pos);
+}
+
+// Screen position of pos in fractional pixels, for drawing with subpixel precision
+vec2 camera_to_pixel(camera_t *camera, vec2 pos)
+{
+    return vec2_create((pos.x - camera->center.x) * camera->zoom + camera->width / 2.0,
+                       (pos.y - camera->center.y) * camera->zoom + camera->height / 2.0);
+}
+
+vec2 camera_to_world(camera_t *camera, double column, double row)
+{
+    return vec2_create(camera->center.x + (column - camera->width / 2.0) / camera->zoom,
+                       camera->center.y + (row - camera->height / 2.0) / camera->zoom);
+}
+
+// Move the view by a number of pixels
+void camera_pan(camera_t *camera, double columns, double rows)
+{
+    camera->center = vec2_add(camera->center, vec2_create(columns / camera->zoom, rows / camera->zoom));
+}
+
+// Zoom by factor, keeping the world point under the given pixel in place
+void camera_zoom_at(camera_t *camera, double factor, int column, int row)
+{
+    vec2 anchor = camera_to_world(camera, column, row);
+    camera->zoom *= factor;
+    if (camera->zoom < MIN_ZOOM)
+        camera->zoom = MIN_ZOOM;
+    if (camera->zoom > MAX_ZOOM)
+        camera->zoom = MAX_ZOOM;
+    vec2 moved = camera_to_world(camera, column, row);
+    camera->center = vec2_add(camera->center, vec2_sub(anchor, moved));
+}
@@ -0,0 +1,31 @@
+#ifndef _CAMERA_H_
+#define _CAMERA_H_
+
+#include "../vec2/vec2.h"
+#include "../gfx/gfx.h"
+
+// Maps the world to the screen: the world point `center` is shown at the
+// middle of the screen, and one world unit spans `zoom` pixels
+typedef struct
+{
+    vec2 center;
+    double zoom;
+    int width;
+    int height;
+} camera_t;
+
+camera_t camera_create(int width, int height);
+
+void camera_visible(camera_t *camera, double *x0, double *x1, double *y0, double *y1);
+
+coordinates_t camera_to_screen(camera_t *camera, vec2 pos);
+
+vec2 camera_to_pixel(camera_t *camera, vec2 pos);
+
+vec2 camera_to_world(camera_t *camera, double column, double row);
+
+void camera_pan(camera_t *camera, double columns, double rows);
+
+void camera_zoom_at(camera_t *camera, double factor, int column, int row);
+
+#endif
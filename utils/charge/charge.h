@@ -3,25 +3,41 @@
 
 #include "../vec2/vec2.h"
 #include "../gfx/gfx.h"
+#include "../memory/memory.h"
+#include "../camera/camera.h"
 #include <SDL2/SDL.h>
 
 typedef struct
 {
   double q;
   vec2 pos;
+  vec2 vel; // Only used by inertial dynamics, mass is 1
+  uint32_t id; // Stays with the charge when the array is reordered
 } charge_t;
 
+extern const float K;
+
+// Field at p from another source than the charges, e.g. a mesh.
+// Returns false where the field is unknown.
+typedef bool (*field_sampler_t)(void *user, vec2 p, vec2 *e);
+
 bool compute_e(charge_t c, vec2 p, double treshold, vec2 *e);
 
 bool compute_total_normalized_e(charge_t *charges, int num_charges, vec2 p, double treshold, vec2 *e);
 
+void compute_total_e_batch(charge_t *charges, int num_charges, const vec2 *points, int num_points, double treshold, vec2 *e, bool *valid);
+
+double compute_total_potential(charge_t *charges, int num_charges, vec2 p);
+
 bool draw_field_line(struct gfx_context_t *ctxt, charge_t *charges, int num_charges, double dx, vec2 pos0, double x0, double x1, double y0, double y1);
 
 bool draw_field_lines(struct gfx_context_t *ctxt, charge_t *charges, int num_charges, double dx, vec2 pos0, double x0, double x1, double y0, double y1);
 
-void draw_charges(struct gfx_context_t *context, charge_t *charges, int num_charges, double x0, double x1, double y0, double y1);
+void draw_charges(struct gfx_context_t *context, camera_t *camera, charge_t *charges, int *visible, int num_visible);
+
+void compute_forces(charge_t *charges, int num_charges, vec2 *forces, double *energy, arena_t *arena);
 
-void update_charges(charge_t *charges, int num_charges, double dt);
+void update_charges(charge_t *charges, int num_charges, double dt, arena_t *arena);
 
 charge_t charge_create(double q, vec2 pos);
 
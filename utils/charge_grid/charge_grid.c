@@ -0,0 +1,140 @@
+#include <math.h>
+#include <string.h>
+#include "charge_grid.h"
+
+// Past this many cells the grid is coarsened, a scattered handful of
+// charges should not cost a huge empty grid
+#define MAX_CELLS (1 << 20)
+
+void charge_grid_init(charge_grid_t *grid)
+{
+    memset(grid, 0, sizeof(charge_grid_t));
+}
+
+void charge_grid_free(charge_grid_t *grid)
+{
+    mem_free(grid->cell_start);
+    mem_free(grid->indices);
+    charge_grid_init(grid);
+}
+
+static int clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static int cell_column(charge_grid_t *grid, double x)
+{
+    return clamp(floor((x - grid->origin.x) / grid->cell), 0, grid->width - 1);
+}
+
+static int cell_row(charge_grid_t *grid, double y)
+{
+    return clamp(floor((y - grid->origin.y) / grid->cell), 0, grid->height - 1);
+}
+
+// Bucket the charges by cell with a counting sort
+void charge_grid_build(charge_grid_t *grid, charge_t *charges, int num_charges, double cell)
+{
+    grid->charges = charges;
+    grid->num_charges = num_charges;
+
+    vec2 lo = vec2_create(0, 0), hi = vec2_create(0, 0);
+    for (int i = 0; i < num_charges; i++)
+    {
+        vec2 p = charges[i].pos;
+        lo = i == 0 ? p : vec2_create(fmin(lo.x, p.x), fmin(lo.y, p.y));
+        hi = i == 0 ? p : vec2_create(fmax(hi.x, p.x), fmax(hi.y, p.y));
+    }
+    while (((hi.x - lo.x) / cell + 1) * ((hi.y - lo.y) / cell + 1) > MAX_CELLS)
+        cell *= 2;
+
+    grid->cell = cell;
+    grid->origin = lo;
+    grid->width = (int)((hi.x - lo.x) / cell) + 1;
+    grid->height = (int)((hi.y - lo.y) / cell) + 1;
+
+    int num_cells = grid->width * grid->height;
+    if (num_cells + 1 > grid->cells_capacity)
+    {
+        grid->cells_capacity = num_cells + 1;
+        grid->cell_start = mem_realloc(grid->cell_start, grid->cells_capacity * sizeof(int));
+    }
+    if (num_charges > grid->indices_capacity)
+    {
+        grid->indices_capacity = num_charges;
+        grid->indices = mem_realloc(grid->indices, grid->indices_capacity * sizeof(int));
+    }
+
+    memset(grid->cell_start, 0, (num_cells + 1) * sizeof(int));
+    for (int i = 0; i < num_charges; i++)
+        grid->cell_start[cell_row(grid, charges[i].pos.y) * grid->width + cell_column(grid, charges[i].pos.x) + 1]++;
+    for (int c = 0; c < num_cells; c++)
+        grid->cell_start[c + 1] += grid->cell_start[c];
+    for (int i = 0; i < num_charges; i++)
+    {
+        int c = cell_row(grid, charges[i].pos.y) * grid->width + cell_column(grid, charges[i].pos.x);
+        grid->indices[grid->cell_start[c]++] = i;
+    }
+    // The fill pass shifted every start to the next cell
+    for (int c = num_cells; c > 0; c--)
+        grid->cell_start[c] = grid->cell_start[c - 1];
+    grid->cell_start[0] = 0;
+}
+
+// Index of the charge closest to p within radius, or -1 if there is none
+int charge_grid_nearest(charge_grid_t *grid, vec2 p, double radius)
+{
+    if (grid->num_charges == 0)
+        return -1;
+
+    int best = -1;
+    double best_dist = radius * radius;
+    int c0 = cell_column(grid, p.x - radius), c1 = cell_column(grid, p.x + radius);
+    int r0 = cell_row(grid, p.y - radius), r1 = cell_row(grid, p.y + radius);
+    for (int r = r0; r <= r1; r++)
+    {
+        for (int c = c0; c <= c1; c++)
+        {
+            int cell = r * grid->width + c;
+            for (int k = grid->cell_start[cell]; k < grid->cell_start[cell + 1]; k++)
+            {
+                int i = grid->indices[k];
+                vec2 d = vec2_sub(grid->charges[i].pos, p);
+                double dist = d.x * d.x + d.y * d.y;
+                if (dist <= best_dist)
+                {
+                    best_dist = dist;
+                    best = i;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+// Write the indices of the charges inside [x0,x1]x[y0,y1] to out.
+// Returns how many were written, out must have room for all the charges.
+int charge_grid_query(charge_grid_t *grid, double x0, double x1, double y0, double y1, int *out)
+{
+    if (grid->num_charges == 0)
+        return 0;
+
+    int n = 0;
+    int c0 = cell_column(grid, x0), c1 = cell_column(grid, x1);
+    int r0 = cell_row(grid, y0), r1 = cell_row(grid, y1);
+    for (int r = r0; r <= r1; r++)
+    {
+        for (int c = c0; c <= c1; c++)
+        {
+            int cell = r * grid->width + c;
+            for (int k = grid->cell_start[cell]; k < grid->cell_start[cell + 1]; k++)
+            {
+                vec2 pos = grid->charges[grid->indices[k]].pos;
+                if (pos.x >= x0 && pos.x <= x1 && pos.y >= y0 && pos.y <= y1)
+                    out[n++] = grid->indices[k];
+            }
+        }
+    }
+    return n;
+}
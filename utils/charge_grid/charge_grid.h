@@ -0,0 +1,34 @@
+#ifndef _CHARGE_GRID_H_
+#define _CHARGE_GRID_H_
+
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../memory/memory.h"
+
+// Uniform grid over the bounding box of a set of charges.
+// The charges of cell c are indices[cell_start[c] .. cell_start[c + 1]).
+typedef struct
+{
+    charge_t *charges;
+    int num_charges;
+    double cell;
+    vec2 origin;
+    int width;
+    int height;
+    int *cell_start;
+    int *indices;
+    int cells_capacity;
+    int indices_capacity;
+} charge_grid_t;
+
+void charge_grid_init(charge_grid_t *grid);
+
+void charge_grid_free(charge_grid_t *grid);
+
+void charge_grid_build(charge_grid_t *grid, charge_t *charges, int num_charges, double cell);
+
+int charge_grid_nearest(charge_grid_t *grid, vec2 p, double radius);
+
+int charge_grid_query(charge_grid_t *grid, double x0, double x1, double y0, double y1, int *out);
+
+#endif
@@ -0,0 +1,258 @@
+#include <math.h>
+#include <string.h>
+#include "conductor.h"
+
+// Panels closer than this many panel lengths are integrated exactly,
+// further ones are taken as a point at their middle
+#define NEAR_PANELS 2
+
+// Panels of one edge or circle at most: a conductor much longer than the
+// panel length gets longer panels, rather than a dense system too large
+// to solve between two frames
+#define MAX_PANELS 64
+
+// The charges have to change by this much before the densities are solved again
+#define RESOLVE_TOLERANCE 1e-2
+
+typedef struct
+{
+    conductors_t *c;
+    int *near_start; // Panels near panel i are near[near_start[i] .. near_start[i + 1])
+    int *near;
+} bem_system_t;
+
+conductors_t *conductors_create(double panel_length)
+{
+    conductors_t *c = mem_calloc(1, sizeof(conductors_t));
+    if (!c)
+        return NULL;
+    c->panel_length = panel_length;
+    c->solver = gmres_create(40, 400, 1e-8);
+    charge_grid_init(&c->panel_grid);
+    return c;
+}
+
+void conductors_destroy(conductors_t *c)
+{
+    mem_free(c->panels);
+    mem_free(c->potentials);
+    mem_free(c->density);
+    mem_free(c->induced);
+    mem_free(c->snapshot);
+    charge_grid_free(&c->panel_grid);
+    mem_free(c);
+}
+
+void conductors_clear(conductors_t *c)
+{
+    c->num_panels = 0;
+    c->num_conductors = 0;
+    c->num_induced = 0;
+    c->changed = true;
+}
+
+static void add_panel(conductors_t *c, vec2 a, vec2 b, double potential)
+{
+    if (c->num_panels == c->capacity)
+    {
+        c->capacity = c->capacity ? 2 * c->capacity : 256;
+        c->panels = mem_realloc(c->panels, c->capacity * sizeof(panel_t));
+        c->potentials = mem_realloc(c->potentials, c->capacity * sizeof(double));
+        c->density = mem_realloc(c->density, c->capacity * sizeof(double));
+        c->induced = mem_realloc(c->induced, c->capacity * sizeof(charge_t));
+    }
+    panel_t *p = &c->panels[c->num_panels];
+    p->a = a;
+    p->b = b;
+    p->mid = vec2_mul(0.5, vec2_add(a, b));
+    p->length = vec2_norm(vec2_sub(b, a));
+    p->conductor = c->num_conductors;
+    c->potentials[c->num_panels] = potential;
+    c->density[c->num_panels] = 0;
+    c->num_panels++;
+    c->changed = true;
+}
+
+static void add_edge(conductors_t *c, vec2 a, vec2 b, double potential)
+{
+    int n = fmin(MAX_PANELS, fmax(1, ceil(vec2_norm(vec2_sub(b, a)) / c->panel_length)));
+    vec2 step = vec2_mul(1.0 / n, vec2_sub(b, a));
+    for (int i = 0; i < n; i++)
+        add_panel(c, vec2_add(a, vec2_mul(i, step)), vec2_add(a, vec2_mul(i + 1, step)), potential);
+}
+
+void conductors_add_segment(conductors_t *c, vec2 a, vec2 b, double potential)
+{
+    add_edge(c, a, b, potential);
+    c->num_conductors++;
+}
+
+// A closed polygon, the last vertex is joined to the first one
+void conductors_add_polygon(conductors_t *c, vec2 *vertices, int num_vertices, double potential)
+{
+    for (int i = 0; i < num_vertices; i++)
+        add_edge(c, vertices[i], vertices[(i + 1) % num_vertices], potential);
+    c->num_conductors++;
+}
+
+void conductors_add_circle(conductors_t *c, vec2 center, double radius, double potential)
+{
+    int n = fmin(MAX_PANELS, fmax(8, ceil(2 * M_PI * radius / c->panel_length)));
+    for (int i = 0; i < n; i++)
+    {
+        double a0 = 2 * M_PI * i / n, a1 = 2 * M_PI * (i + 1) / n;
+        add_panel(c, vec2_add(center, vec2_create(radius * cos(a0), radius * sin(a0))),
+                  vec2_add(center, vec2_create(radius * cos(a1), radius * sin(a1))), potential);
+    }
+    c->num_conductors++;
+}
+
+// Antiderivative of ln(sqrt(w^2 + v^2)) over w
+static double log_antiderivative(double w, double v)
+{
+    double r2 = w * w + v * v;
+    double f = (r2 > 0 ? 0.5 * w * log(r2) : 0) - w;
+    if (v != 0)
+        f += v * atan(w / v);
+    return f;
+}
+
+// Integral of ln|x - y| for y along the panel
+static double panel_log_integral(panel_t *p, vec2 x)
+{
+    vec2 t = vec2_mul(1 / p->length, vec2_sub(p->b, p->a));
+    vec2 d = vec2_sub(x, p->a);
+    double u = vec2_dot(d, t);
+    double v = d.x * -t.y + d.y * t.x;
+    return log_antiderivative(p->length - u, v) - log_antiderivative(-u, v);
+}
+
+// Potential at the middle of every panel for the given densities: every
+// panel is a point at its middle, corrected by the exact integral for
+// the neighbouring panels
+static void bem_matvec(void *user, const double *x, double *y, int n)
+{
+    bem_system_t *system = user;
+    panel_t *panels = system->c->panels;
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        double sum = 0;
+        for (int j = 0; j < n; j++)
+        {
+            if (j == i)
+                continue;
+            vec2 d = vec2_sub(panels[i].mid, panels[j].mid);
+            sum += x[j] * panels[j].length * 0.5 * log(d.x * d.x + d.y * d.y);
+        }
+        for (int k = system->near_start[i]; k < system->near_start[i + 1]; k++)
+        {
+            int j = system->near[k];
+            double exact = panel_log_integral(&panels[j], panels[i].mid);
+            if (j != i)
+            {
+                vec2 d = vec2_sub(panels[i].mid, panels[j].mid);
+                exact -= panels[j].length * 0.5 * log(d.x * d.x + d.y * d.y);
+            }
+            sum += x[j] * exact;
+        }
+        y[i] = K * sum;
+    }
+}
+
+static bool charges_changed(conductors_t *c, charge_t *charges, int num_charges)
+{
+    if (c->changed || num_charges != c->snapshot_count)
+        return true;
+    for (int i = 0; i < num_charges; i++)
+    {
+        charge_t old = c->snapshot[i];
+        if (old.pos.x != charges[i].pos.x || old.pos.y != charges[i].pos.y ||
+            fabs(charges[i].q - old.q) > RESOLVE_TOLERANCE * fabs(old.q))
+            return true;
+    }
+    return false;
+}
+
+// Solve the panel densities for the given charges, with the previous
+// densities as initial guess. Nothing is done unless the conductors or
+// the charges changed enough since the last solve.
+// Returns true if the densities were solved again.
+bool conductors_solve(conductors_t *c, arena_t *arena, charge_t *charges, int num_charges)
+{
+    int n = c->num_panels;
+    if (!charges_changed(c, charges, num_charges))
+        return false;
+
+    if (num_charges > c->snapshot_capacity)
+    {
+        c->snapshot_capacity = num_charges;
+        c->snapshot = mem_realloc(c->snapshot, num_charges * sizeof(charge_t));
+    }
+    memcpy(c->snapshot, charges, num_charges * sizeof(charge_t));
+    c->snapshot_count = num_charges;
+    c->changed = false;
+    c->num_induced = 0;
+    if (n == 0)
+        return true;
+
+    // Neighbours of every panel, found through a grid of their middles
+    charge_t *mids = arena_alloc(arena, n * sizeof(charge_t));
+    for (int i = 0; i < n; i++)
+        mids[i] = charge_create(1, c->panels[i].mid);
+    charge_grid_build(&c->panel_grid, mids, n, NEAR_PANELS * c->panel_length);
+
+    bem_system_t system = {.c = c};
+    system.near_start = arena_alloc(arena, (n + 1) * sizeof(int));
+    int *found = arena_alloc(arena, n * sizeof(int));
+    int num_near = 0, near_capacity = 16 * n;
+    system.near = arena_alloc(arena, near_capacity * sizeof(int));
+    for (int i = 0; i < n; i++)
+    {
+        system.near_start[i] = num_near;
+        double r = NEAR_PANELS * c->panel_length + c->panels[i].length;
+        vec2 m = c->panels[i].mid;
+        int count = charge_grid_query(&c->panel_grid, m.x - r, m.x + r, m.y - r, m.y + r, found);
+        if (num_near + count > near_capacity)
+        {
+            int *grown = arena_alloc(arena, 2 * (num_near + count) * sizeof(int));
+            memcpy(grown, system.near, num_near * sizeof(int));
+            system.near = grown;
+            near_capacity = 2 * (num_near + count);
+        }
+        memcpy(system.near + num_near, found, count * sizeof(int));
+        num_near += count;
+    }
+    system.near_start[n] = num_near;
+
+    // The panels make up for the potential of the charges
+    double *b = arena_alloc(arena, n * sizeof(double));
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+        b[i] = c->potentials[i] - compute_total_potential(charges, num_charges, c->panels[i].mid);
+
+    gmres_solve(&c->solver, arena, bem_matvec, &system, b, c->density, n);
+
+    // Panels of negligible density would be charges of huge q
+    double largest = 0;
+    for (int i = 0; i < n; i++)
+        largest = fmax(largest, fabs(c->density[i] * c->panels[i].length));
+    for (int i = 0; i < n; i++)
+    {
+        double inverse_q = c->density[i] * c->panels[i].length;
+        if (fabs(inverse_q) > 1e-9 * largest)
+            c->induced[c->num_induced++] = charge_create(1 / inverse_q, c->panels[i].mid);
+    }
+    return true;
+}
+
+void draw_conductors(struct gfx_context_t *ctxt, camera_t *camera, conductors_t *c)
+{
+    for (int i = 0; i < c->num_panels; i++)
+    {
+        coordinates_t a = camera_to_screen(camera, c->panels[i].a);
+        coordinates_t b = camera_to_screen(camera, c->panels[i].b);
+        draw_line(ctxt, (int)a.column, (int)a.row, (int)b.column, (int)b.row, MAKE_COLOR(0, 0, 0));
+    }
+}
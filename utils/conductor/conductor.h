@@ -0,0 +1,65 @@
+#ifndef _CONDUCTOR_H_
+#define _CONDUCTOR_H_
+
+#include <stdbool.h>
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../charge_grid/charge_grid.h"
+#include "../camera/camera.h"
+#include "../gmres/gmres.h"
+#include "../memory/memory.h"
+
+// A straight piece of conductor surface carrying a uniform density
+typedef struct
+{
+    vec2 a, b;
+    vec2 mid;
+    double length;
+    int conductor;
+} panel_t;
+
+// Conductors held at fixed potentials, solved with a boundary-element
+// method: each conductor is cut into panels of uniform density, and the
+// densities are set so that the potential at the middle of every panel
+// is the one of its conductor.
+//
+// With the law of compute_e, a charge q has the potential K/q * ln(r), so
+// the density of a panel is a density of 1/q. Once solved, every panel
+// stands as a point charge of 1/q = density * length, fed to field lines
+// along with the real charges.
+typedef struct
+{
+    panel_t *panels;
+    double *potentials; // Potential of the conductor of each panel
+    double *density;    // Solution, kept as initial guess of the next solve
+    int num_panels;
+    int capacity;
+    int num_conductors;
+    double panel_length;
+    charge_t *induced;  // Panels as point charges
+    int num_induced;
+    charge_grid_t panel_grid; // Middles of the panels, to find neighbours
+    charge_t *snapshot;       // Charges of the last solve
+    int snapshot_count;
+    int snapshot_capacity;
+    bool changed;             // Conductors were added since the last solve
+    gmres_t solver;
+} conductors_t;
+
+conductors_t *conductors_create(double panel_length);
+
+void conductors_destroy(conductors_t *c);
+
+void conductors_clear(conductors_t *c);
+
+void conductors_add_segment(conductors_t *c, vec2 a, vec2 b, double potential);
+
+void conductors_add_polygon(conductors_t *c, vec2 *vertices, int num_vertices, double potential);
+
+void conductors_add_circle(conductors_t *c, vec2 center, double radius, double potential);
+
+bool conductors_solve(conductors_t *c, arena_t *arena, charge_t *charges, int num_charges);
+
+void draw_conductors(struct gfx_context_t *ctxt, camera_t *camera, conductors_t *c);
+
+#endif
@@ -0,0 +1,94 @@
+#include <math.h>
+#include <string.h>
+#include "density.h"
+#include "../gfx/raster.h"
+#include "../memory/memory.h"
+
+void density_init(density_buffer_t *db, uint32_t width, uint32_t height, float exposure, uint32_t color)
+{
+    db->width = width;
+    db->height = height;
+    db->tiles_x = (width + DENSITY_TILE - 1) / DENSITY_TILE;
+    db->tiles_y = (height + DENSITY_TILE - 1) / DENSITY_TILE;
+    db->density = mem_calloc((size_t)width * height, sizeof(float));
+    db->touched = mem_calloc((size_t)db->tiles_x * db->tiles_y, sizeof(bool));
+    db->exposure = exposure;
+    db->color = color;
+}
+
+void density_free(density_buffer_t *db)
+{
+    mem_free(db->density);
+    mem_free(db->touched);
+}
+
+// Bilinear splat of weight at (x, y)
+static void splat(density_buffer_t *db, double x, double y, float weight)
+{
+    double fx = x - 0.5, fy = y - 0.5; // Pixel centers
+    int i = floor(fx), j = floor(fy);
+    if (i < -1 || j < -1 || i >= (int)db->width || j >= (int)db->height)
+        return;
+    float tx = fx - i, ty = fy - j;
+    float w[4] = {(1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty};
+    for (int k = 0; k < 4; k++)
+    {
+        int column = i + (k & 1), row = j + (k >> 1);
+        if (column < 0 || row < 0 || column >= (int)db->width || row >= (int)db->height)
+            continue;
+        db->density[(size_t)row * db->width + column] += weight * w[k];
+        db->touched[row / DENSITY_TILE * db->tiles_x + column / DENSITY_TILE] = true;
+    }
+}
+
+// Add weight per pixel of length along the segment, so that a line gets
+// the same density whatever its number of points. A segment shorter than
+// a pixel only adds its length, lines are traced in steps of a fraction
+// of a pixel.
+void density_add_segment(density_buffer_t *db, double x0, double y0, double x1, double y1, float weight)
+{
+    double length = hypot(x1 - x0, y1 - y0);
+    // Entirely outside, with a pixel of margin for the splats
+    if ((x0 < -1 && x1 < -1) || (y0 < -1 && y1 < -1) ||
+        (x0 > db->width + 1 && x1 > db->width + 1) || (y0 > db->height + 1 && y1 > db->height + 1))
+        return;
+    int steps = fmax(1, ceil(length));
+    float share = weight * length / steps;
+    for (int s = 0; s < steps; s++)
+    {
+        double t = (s + 0.5) / steps;
+        splat(db, x0 + t * (x1 - x0), y0 + t * (y1 - y0), share);
+    }
+}
+
+// Draw the ink over the pixels with an alpha of 1 - exp(-density / exposure),
+// tile by tile in parallel, and clear the density for the next frame
+void density_tonemap(struct gfx_context_t *ctxt, density_buffer_t *db)
+{
+    int num_tiles = db->tiles_x * db->tiles_y;
+    uint32_t ink = db->color & 0x00ffffff;
+    float scale = -1 / db->exposure;
+
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < num_tiles; t++)
+    {
+        if (!db->touched[t])
+            continue;
+        uint32_t x0 = t % db->tiles_x * DENSITY_TILE, y0 = t / db->tiles_x * DENSITY_TILE;
+        uint32_t x1 = fmin(x0 + DENSITY_TILE, fmin(db->width, ctxt->width));
+        uint32_t y1 = fmin(y0 + DENSITY_TILE, fmin(db->height, ctxt->height));
+        uint32_t layer[DENSITY_TILE];
+        for (uint32_t row = y0; row < y1; row++)
+        {
+            float *density = db->density + (size_t)row * db->width;
+            for (uint32_t column = x0; column < x1; column++)
+            {
+                uint32_t alpha = 255.5f * (1 - expf(density[column] * scale));
+                layer[column - x0] = ink | alpha << 24;
+                density[column] = 0;
+            }
+            raster_composite(ctxt->pixels + (size_t)row * ctxt->width + x0, layer, x1 - x0);
+        }
+        db->touched[t] = false;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef _DENSITY_H_
+#define _DENSITY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../gfx/gfx.h"
+
+#define DENSITY_TILE 64
+
+// Float buffer the field lines add their density to, turned into pixels
+// by one tonemap pass. Only the tiles something was added to are mapped.
+typedef struct
+{
+    float *density;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    bool *touched;  // Tiles holding some density
+    float exposure; // Density giving 63% of the ink
+    uint32_t color; // Ink of the lines
+} density_buffer_t;
+
+void density_init(density_buffer_t *db, uint32_t width, uint32_t height, float exposure, uint32_t color);
+
+void density_free(density_buffer_t *db);
+
+void density_add_segment(density_buffer_t *db, double x0, double y0, double x1, double y1, float weight);
+
+void density_tonemap(struct gfx_context_t *ctxt, density_buffer_t *db);
+
+#endif
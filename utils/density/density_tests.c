@@ -0,0 +1,115 @@
+#include "density.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+typedef struct _test_result
+{
+    bool passed;
+    const char *name;
+} test_result;
+
+typedef test_result (*unit_test_t)(void);
+
+void print_in_color(char *color, char *text)
+{
+    printf("\033%s", color);
+    printf("%s", text);
+    printf("\033[0m");
+}
+void print_in_red(char *text)
+{
+    print_in_color("[0;31m", text);
+}
+void print_in_green(char *text)
+{
+    print_in_color("[0;32m", text);
+}
+
+#define SIZE 64
+
+// Same line from (x0, y0) to (x1, y1), as one segment and as segments of
+// step pixels like the traced field lines
+static bool same_density(double x0, double y0, double x1, double y1, double step)
+{
+    density_buffer_t whole, split;
+    density_init(&whole, SIZE, SIZE, 1.5, 0);
+    density_init(&split, SIZE, SIZE, 1.5, 0);
+    density_add_segment(&whole, x0, y0, x1, y1, 1);
+    double length = hypot(x1 - x0, y1 - y0);
+    int n = ceil(length / step);
+    for (int s = 0; s < n; s++)
+    {
+        double t0 = (double)s / n, t1 = (double)(s + 1) / n;
+        density_add_segment(&split, x0 + t0 * (x1 - x0), y0 + t0 * (y1 - y0), x0 + t1 * (x1 - x0), y0 + t1 * (y1 - y0), 1);
+    }
+
+    // The ink is the same in total, one unit per pixel of length. Pixel by
+    // pixel the two differ by the spacing of the splats, up to a pixel for
+    // the single segment, far below the unit a segment shorter than a pixel
+    // would add if it were rounded up to a pixel.
+    double total_whole = 0, total_split = 0, worst = 0;
+    for (int k = 0; k < SIZE * SIZE; k++)
+    {
+        total_whole += whole.density[k];
+        total_split += split.density[k];
+        worst = fmax(worst, fabs(whole.density[k] - split.density[k]));
+    }
+    bool passed = fabs(total_whole - total_split) < 1e-3 * total_whole && fabs(total_whole - length) < 1e-3 * length;
+    passed = passed && worst < 0.25;
+    density_free(&whole);
+    density_free(&split);
+    return passed;
+}
+
+test_result t_density_add_segment_0()
+{
+    // Lines traced in 0.088 pixel steps, horizontal and slanted
+    bool passed = same_density(10.3, 20.5, 40.7, 20.5, 0.088) &&
+                  same_density(8.2, 9.9, 51.4, 47.3, 0.088);
+    return (test_result){.passed = passed,
+                         .name = "Test density_add_segment 0"};
+}
+test_result t_density_add_segment_1()
+{
+    // Steps around a pixel
+    bool passed = same_density(10.3, 20.5, 40.7, 20.5, 0.7) &&
+                  same_density(8.2, 9.9, 51.4, 47.3, 1.3);
+    return (test_result){.passed = passed,
+                         .name = "Test density_add_segment 1"};
+}
+//Add or remove your test function name here
+const unit_test_t tests[] = {
+    t_density_add_segment_0,
+    t_density_add_segment_1};
+
+int main()
+{
+    uint32_t nb_tests = sizeof(tests) / sizeof(unit_test_t);
+    char message[256];
+    bool all_passed = true;
+
+    for (uint32_t i = 0; i < nb_tests; i++)
+    {
+        printf("Running test n°%d: ...\n", i);
+        test_result r = tests[i]();
+        if (r.passed)
+        {
+            sprintf(message, "\t- %s : OK", r.name);
+            print_in_green(message);
+        }
+        else
+        {
+            all_passed = false;
+            sprintf(message, "\t- %s : FAILED", r.name);
+            print_in_red(message);
+        }
+        printf("\n");
+    }
+    if (all_passed)
+        print_in_green("\nTests suite result : OK\n");
+    else
+        print_in_red("\nTests suite result : FAILED\n");
+}
@@ -0,0 +1,673 @@
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "domain.h"
+#include "../memory/memory.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// r^2 is never taken below this, as in the Coulomb kernel of interaction.c
+#define MIN_DISTANCE_SQ 1e-3
+
+// Charges per cell the grid is sized for
+#define CHARGES_PER_CELL 16
+
+// Columns per worker at least, the slabs are moved by whole columns
+#define COLUMNS_PER_WORKER 16
+
+// Levels of the pyramid of cells, from the grid to a single cell
+#define MAX_LEVELS 9
+
+// Largest slab count over the mean tolerated before the slabs are moved
+#define MAX_IMBALANCE 1.1
+
+typedef enum
+{
+    COMMAND_MIGRATE, // Charges outside the slab go to the outbox
+    COMMAND_GATHER,  // Charges of the slab taken from every outbox, sorted by cell
+    COMMAND_FORCES,  // Forces on the charges of the slab
+    COMMAND_MOVE,    // Charges moved by dt times their force
+    COMMAND_QUIT
+} command_t;
+
+// Written by the coordinator between two commands, read by every worker:
+// the grid, the owner of each column and dt. Written by each worker for
+// itself: its counts, bounds and histogram. Every cell is written by the
+// worker owning its column. The slabs and the outboxes of the workers,
+// capacity charges each, follow in the mapping.
+struct _domain_shared
+{
+    double dt;
+    double x0, y0, cell_width, cell_height;
+    int columns, rows;
+    int owner[DOMAIN_MAX_SIDE];
+    double bounds[DOMAIN_MAX_WORKERS + 1]; // Slab edges in x, owner of a column is the slab of its center
+    int count[DOMAIN_MAX_WORKERS];
+    int outgoing[DOMAIN_MAX_WORKERS];
+    double min_x[DOMAIN_MAX_WORKERS], max_x[DOMAIN_MAX_WORKERS];
+    double min_y[DOMAIN_MAX_WORKERS], max_y[DOMAIN_MAX_WORKERS];
+    double sum_x[DOMAIN_MAX_WORKERS], sum_xx[DOMAIN_MAX_WORKERS]; // Moments of the positions
+    double sum_y[DOMAIN_MAX_WORKERS], sum_yy[DOMAIN_MAX_WORKERS];
+    int histogram[DOMAIN_MAX_WORKERS][DOMAIN_MAX_SIDE]; // Charges of the worker in each column
+    domain_cell_t cells[DOMAIN_MAX_SIDE * DOMAIN_MAX_SIDE];
+};
+
+// Private state of a worker process
+typedef struct
+{
+    int id;
+    int num_workers;
+    int capacity;
+    domain_shared_t *shared;
+    vec2 *forces;
+    charge_t *sorted;
+    int *offsets;
+    domain_cell_t *levels[MAX_LEVELS]; // Cells merged 2x2 from the level below, level 0 is the grid
+    int level_columns[MAX_LEVELS];
+    int level_rows[MAX_LEVELS];
+    int num_levels;
+    domain_cell_t *far;          // Cells summed through their multipoles
+    const charge_t **near;       // Charges of the cells summed pair by pair
+    int *near_counts;
+} worker_t;
+
+static charge_t *slab(domain_shared_t *s, int capacity, int worker)
+{
+    return (charge_t *)(s + 1) + (size_t)worker * capacity;
+}
+
+static charge_t *outbox(domain_shared_t *s, int capacity, int num_workers, int worker)
+{
+    return slab(s, capacity, num_workers + worker);
+}
+
+static int column_of(const domain_shared_t *s, double x)
+{
+    int c = (int)floor((x - s->x0) / s->cell_width);
+    return c < 0 ? 0 : c >= s->columns ? s->columns - 1 : c;
+}
+
+static int row_of(const domain_shared_t *s, double y)
+{
+    int r = (int)floor((y - s->y0) / s->cell_height);
+    return r < 0 ? 0 : r >= s->rows ? s->rows - 1 : r;
+}
+
+static void set_bounds(domain_shared_t *s, int worker, const charge_t *charges, int n)
+{
+    s->min_x[worker] = s->min_y[worker] = INFINITY;
+    s->max_x[worker] = s->max_y[worker] = -INFINITY;
+    s->sum_x[worker] = s->sum_xx[worker] = s->sum_y[worker] = s->sum_yy[worker] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        s->sum_x[worker] += charges[i].pos.x;
+        s->sum_xx[worker] += charges[i].pos.x * charges[i].pos.x;
+        s->sum_y[worker] += charges[i].pos.y;
+        s->sum_yy[worker] += charges[i].pos.y * charges[i].pos.y;
+        s->min_x[worker] = fmin(s->min_x[worker], charges[i].pos.x);
+        s->max_x[worker] = fmax(s->max_x[worker], charges[i].pos.x);
+        s->min_y[worker] = fmin(s->min_y[worker], charges[i].pos.y);
+        s->max_y[worker] = fmax(s->max_y[worker], charges[i].pos.y);
+    }
+}
+
+// Columns owned by a worker are contiguous, first == last when none
+static void owned_columns(const domain_shared_t *s, int worker, int *first, int *last)
+{
+    *first = *last = 0;
+    for (int c = 0; c < s->columns; c++)
+        if (s->owner[c] == worker)
+        {
+            if (*first == *last)
+                *first = c;
+            *last = c + 1;
+        }
+}
+
+static void worker_migrate(worker_t *w)
+{
+    domain_shared_t *s = w->shared;
+    charge_t *own = slab(s, w->capacity, w->id);
+    charge_t *out = outbox(s, w->capacity, w->num_workers, w->id);
+    int kept = 0, sent = 0;
+    for (int i = 0; i < s->count[w->id]; i++)
+    {
+        if (s->owner[column_of(s, own[i].pos.x)] == w->id)
+            own[kept++] = own[i];
+        else
+            out[sent++] = own[i];
+    }
+    s->count[w->id] = kept;
+    s->outgoing[w->id] = sent;
+}
+
+// Takes in the charges sent to the slab, then counting sorts them by cell
+// and writes the cells of the slab
+static void worker_gather(worker_t *w)
+{
+    domain_shared_t *s = w->shared;
+    charge_t *own = slab(s, w->capacity, w->id);
+    int n = s->count[w->id];
+    for (int k = 0; k < w->num_workers; k++)
+    {
+        const charge_t *in = outbox(s, w->capacity, w->num_workers, k);
+        for (int i = 0; i < s->outgoing[k]; i++)
+            if (s->owner[column_of(s, in[i].pos.x)] == w->id)
+                own[n++] = in[i];
+    }
+    s->count[w->id] = n;
+
+    int first, last;
+    owned_columns(s, w->id, &first, &last);
+    int num_cells = (last - first) * s->rows;
+    memset(w->offsets, 0, (num_cells + 1) * sizeof(int));
+    for (int i = 0; i < n; i++)
+        w->offsets[(column_of(s, own[i].pos.x) - first) * s->rows + row_of(s, own[i].pos.y) + 1]++;
+    for (int k = 0; k < num_cells; k++)
+        w->offsets[k + 1] += w->offsets[k];
+    for (int i = 0; i < n; i++)
+        w->sorted[w->offsets[(column_of(s, own[i].pos.x) - first) * s->rows + row_of(s, own[i].pos.y)]++] = own[i];
+    memcpy(own, w->sorted, n * sizeof(charge_t));
+
+    memset(s->histogram[w->id], 0, sizeof(s->histogram[w->id]));
+    int start = 0;
+    for (int c = first; c < last; c++)
+        for (int r = 0; r < s->rows; r++)
+        {
+            domain_cell_t *cell = &s->cells[c * s->rows + r];
+            int end = w->offsets[(c - first) * s->rows + r];
+            memset(cell, 0, sizeof(*cell));
+            cell->start = start;
+            cell->count = end - start;
+            double x0 = INFINITY, x1 = -INFINITY, y0 = INFINITY, y1 = -INFINITY;
+            for (int i = start; i < end; i++)
+            {
+                x0 = fmin(x0, own[i].pos.x);
+                x1 = fmax(x1, own[i].pos.x);
+                y0 = fmin(y0, own[i].pos.y);
+                y1 = fmax(y1, own[i].pos.y);
+            }
+            vec2 center = cell->center = vec2_create((x0 + x1) / 2, (y0 + y1) / 2);
+            for (int i = start; i < end; i++)
+            {
+                double q = own[i].q, dx = own[i].pos.x - center.x, dy = own[i].pos.y - center.y;
+                cell->q += q;
+                cell->px += q * dx;
+                cell->py += q * dy;
+                cell->mxx += q * dx * dx;
+                cell->mxy += q * dx * dy;
+                cell->myy += q * dy * dy;
+                cell->radius = fmax(cell->radius, sqrt(dx * dx + dy * dy));
+            }
+            s->histogram[w->id][c] += cell->count;
+            start = end;
+        }
+    set_bounds(s, w->id, own, n);
+}
+
+// Multipoles of up to 4 cells moved to the center of the disk holding
+// their disks
+static void merge_cells(domain_cell_t *parent, const domain_cell_t **children, int num_children)
+{
+    memset(parent, 0, sizeof(*parent));
+    double x0 = INFINITY, x1 = -INFINITY, y0 = INFINITY, y1 = -INFINITY;
+    for (int k = 0; k < num_children; k++)
+    {
+        const domain_cell_t *child = children[k];
+        if (child->count == 0)
+            continue;
+        parent->count += child->count;
+        x0 = fmin(x0, child->center.x - child->radius);
+        x1 = fmax(x1, child->center.x + child->radius);
+        y0 = fmin(y0, child->center.y - child->radius);
+        y1 = fmax(y1, child->center.y + child->radius);
+    }
+    if (parent->count == 0)
+        return;
+    parent->center = vec2_create((x0 + x1) / 2, (y0 + y1) / 2);
+    for (int k = 0; k < num_children; k++)
+    {
+        const domain_cell_t *child = children[k];
+        if (child->count == 0)
+            continue;
+        double dx = child->center.x - parent->center.x, dy = child->center.y - parent->center.y;
+        parent->radius = fmax(parent->radius, sqrt(dx * dx + dy * dy) + child->radius);
+        parent->q += child->q;
+        parent->px += child->px + child->q * dx;
+        parent->py += child->py + child->q * dy;
+        parent->mxx += child->mxx + 2 * child->px * dx + child->q * dx * dx;
+        parent->mxy += child->mxy + child->px * dy + child->py * dx + child->q * dx * dy;
+        parent->myy += child->myy + 2 * child->py * dy + child->q * dy * dy;
+    }
+}
+
+// Every worker builds the whole pyramid from the cells of all the slabs
+static void build_levels(worker_t *w)
+{
+    domain_shared_t *s = w->shared;
+    w->levels[0] = s->cells;
+    w->level_columns[0] = s->columns;
+    w->level_rows[0] = s->rows;
+    int l = 1;
+    for (; l < MAX_LEVELS && (w->level_columns[l - 1] > 1 || w->level_rows[l - 1] > 1); l++)
+    {
+        int below_rows = w->level_rows[l - 1];
+        w->level_columns[l] = (w->level_columns[l - 1] + 1) / 2;
+        w->level_rows[l] = (below_rows + 1) / 2;
+        for (int c = 0; c < w->level_columns[l]; c++)
+            for (int r = 0; r < w->level_rows[l]; r++)
+            {
+                const domain_cell_t *children[4];
+                int num_children = 0;
+                for (int cc = 2 * c; cc < 2 * c + 2 && cc < w->level_columns[l - 1]; cc++)
+                    for (int cr = 2 * r; cr < 2 * r + 2 && cr < below_rows; cr++)
+                        children[num_children++] = &w->levels[l - 1][cc * below_rows + cr];
+                merge_cells(&w->levels[l][c * w->level_rows[l] + r], children, num_children);
+            }
+    }
+    w->num_levels = l;
+}
+
+// The force of update_charges: pair by pair from the charges of the cells
+// too close for their multipoles, whichever slab holds them, and through
+// the Taylor expansion of the field d/|d|^3 about the center of the
+// largest cells of the pyramid far enough away
+static void worker_forces(worker_t *w)
+{
+    domain_shared_t *s = w->shared;
+    charge_t *own = slab(s, w->capacity, w->id);
+    build_levels(w);
+    int first, last;
+    owned_columns(s, w->id, &first, &last);
+    for (int c = first; c < last; c++)
+        for (int r = 0; r < s->rows; r++)
+        {
+            const domain_cell_t *target = &s->cells[c * s->rows + r];
+            if (target->count == 0)
+                continue;
+
+            // Walk down the pyramid from its top cell, opening the cells
+            // too close to the target
+            int num_far = 0, num_near = 0;
+            int stack[4 * MAX_LEVELS][2] = {{w->num_levels - 1, 0}}, depth = 1;
+            while (depth > 0)
+            {
+                int l = stack[--depth][0], index = stack[depth][1];
+                const domain_cell_t *cell = &w->levels[l][index];
+                if (cell->count == 0)
+                    continue;
+                double reach = (target->radius + cell->radius) / DOMAIN_OPENING;
+                if (vec2_norm_sqr(vec2_sub(cell->center, target->center)) > reach * reach)
+                    w->far[num_far++] = *cell;
+                else if (l == 0)
+                {
+                    w->near[num_near] = slab(s, w->capacity, s->owner[index / s->rows]) + cell->start;
+                    w->near_counts[num_near++] = cell->count;
+                }
+                else
+                {
+                    int rows = w->level_rows[l], below_rows = w->level_rows[l - 1];
+                    int pc = index / rows, pr = index % rows;
+                    for (int cc = 2 * pc; cc < 2 * pc + 2 && cc < w->level_columns[l - 1]; cc++)
+                        for (int cr = 2 * pr; cr < 2 * pr + 2 && cr < below_rows; cr++)
+                        {
+                            stack[depth][0] = l - 1;
+                            stack[depth++][1] = cc * below_rows + cr;
+                        }
+                }
+            }
+
+            for (int i = target->start; i < target->start + target->count; i++)
+            {
+                double x = own[i].pos.x, y = own[i].pos.y, fx = 0, fy = 0;
+                for (int k = 0; k < num_near; k++)
+                {
+                    const charge_t *source = w->near[k];
+                    for (int j = 0; j < w->near_counts[k]; j++)
+                    {
+                        if (source + j == own + i)
+                            continue;
+                        double dx = x - source[j].pos.x, dy = y - source[j].pos.y;
+                        double r2 = dx * dx + dy * dy;
+                        double f = K * own[i].q * source[j].q / (sqrt(r2) * fmax(r2, MIN_DISTANCE_SQ));
+                        fx += f * dx;
+                        fy += f * dy;
+                    }
+                }
+
+                double gx = 0, gy = 0;
+#pragma omp simd reduction(+ : gx, gy)
+                for (int k = 0; k < num_far; k++)
+                {
+                    const domain_cell_t *m = &w->far[k];
+                    double dx = x - m->center.x, dy = y - m->center.y;
+                    double inv = 1 / sqrt(dx * dx + dy * dy);
+                    double inv3 = inv * inv * inv, inv5 = inv3 * inv * inv, inv7 = inv5 * inv * inv;
+                    double pd = m->px * dx + m->py * dy;
+                    double mdx = m->mxx * dx + m->mxy * dy, mdy = m->mxy * dx + m->myy * dy;
+                    double dmd = dx * mdx + dy * mdy, trace = m->mxx + m->myy;
+                    double radial = m->q * inv3 + 3 * pd * inv5 - 1.5 * trace * inv5 + 7.5 * dmd * inv7;
+                    gx += radial * dx - m->px * inv3 - 3 * mdx * inv5;
+                    gy += radial * dy - m->py * inv3 - 3 * mdy * inv5;
+                }
+                w->forces[i] = vec2_create(fx + K * own[i].q * gx, fy + K * own[i].q * gy);
+            }
+        }
+}
+
+static void worker_move(worker_t *w)
+{
+    domain_shared_t *s = w->shared;
+    charge_t *own = slab(s, w->capacity, w->id);
+    for (int i = 0; i < s->count[w->id]; i++)
+        own[i].pos = vec2_add(own[i].pos, vec2_mul(s->dt, w->forces[i]));
+    set_bounds(s, w->id, own, s->count[w->id]);
+}
+
+static bool read_full(int fd, void *data, size_t size)
+{
+    for (size_t done = 0; done < size;)
+    {
+        ssize_t got = read(fd, (char *)data + done, size - done);
+        if (got <= 0)
+            return false;
+        done += got;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *data, size_t size)
+{
+    for (size_t done = 0; done < size;)
+    {
+        ssize_t put = send(fd, (const char *)data + done, size - done, MSG_NOSIGNAL);
+        if (put <= 0)
+            return false;
+        done += put;
+    }
+    return true;
+}
+
+// Runs the commands of the coordinator until it quits or goes away.
+// Workers don't use OpenMP, whose threads don't survive the fork.
+static void worker_run(worker_t *w, int fd)
+{
+    int command;
+    while (read_full(fd, &command, sizeof(command)) && command != COMMAND_QUIT)
+    {
+        switch (command)
+        {
+        case COMMAND_MIGRATE:
+            worker_migrate(w);
+            break;
+        case COMMAND_GATHER:
+            worker_gather(w);
+            break;
+        case COMMAND_FORCES:
+            worker_forces(w);
+            break;
+        case COMMAND_MOVE:
+            worker_move(w);
+            break;
+        }
+        int done = 1;
+        if (!write_full(fd, &done, sizeof(done)))
+            break;
+    }
+}
+
+// Forks the workers, which share one anonymous mapping with room for
+// capacity charges in every slab and every outbox.
+// Returns NULL when the mapping or a worker could not be created.
+domain_t *domain_create(int num_workers, int capacity)
+{
+    if (num_workers < 1 || num_workers > DOMAIN_MAX_WORKERS || capacity < 1)
+        return NULL;
+    domain_t *domain = mem_calloc(1, sizeof(domain_t));
+    if (!domain)
+        return NULL;
+    domain->capacity = capacity;
+    domain->shared_size = sizeof(domain_shared_t) + 2 * (size_t)num_workers * capacity * sizeof(charge_t);
+    domain->shared = mmap(NULL, domain->shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (domain->shared == MAP_FAILED)
+    {
+        mem_free(domain);
+        return NULL;
+    }
+
+    for (int k = 0; k < num_workers; k++)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            break;
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(fds[0]);
+            for (int other = 0; other < k; other++)
+                close(domain->sockets[other]);
+            worker_t w = {.id = k, .num_workers = num_workers, .capacity = capacity, .shared = domain->shared};
+            w.forces = mem_alloc(capacity * sizeof(vec2));
+            w.sorted = mem_alloc(capacity * sizeof(charge_t));
+            w.offsets = mem_alloc((DOMAIN_MAX_SIDE * DOMAIN_MAX_SIDE + 1) * sizeof(int));
+            w.far = mem_alloc(DOMAIN_MAX_SIDE * DOMAIN_MAX_SIDE * sizeof(domain_cell_t));
+            for (int l = 1; l < MAX_LEVELS; l++)
+            {
+                int side = (DOMAIN_MAX_SIDE + (1 << l) - 1) >> l;
+                w.levels[l] = mem_alloc(side * side * sizeof(domain_cell_t));
+                if (!w.levels[l])
+                    _exit(1);
+            }
+            w.near = mem_alloc(DOMAIN_MAX_SIDE * DOMAIN_MAX_SIDE * sizeof(charge_t *));
+            w.near_counts = mem_alloc(DOMAIN_MAX_SIDE * DOMAIN_MAX_SIDE * sizeof(int));
+            if (w.forces && w.sorted && w.offsets && w.far && w.near && w.near_counts)
+                worker_run(&w, fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+        if (pid < 0)
+        {
+            close(fds[0]);
+            break;
+        }
+        domain->pids[k] = pid;
+        domain->sockets[k] = fds[0];
+        domain->num_workers++;
+    }
+    if (domain->num_workers < num_workers)
+    {
+        domain_destroy(domain);
+        return NULL;
+    }
+    return domain;
+}
+
+void domain_destroy(domain_t *domain)
+{
+    int command = COMMAND_QUIT;
+    for (int k = 0; k < domain->num_workers; k++)
+    {
+        write_full(domain->sockets[k], &command, sizeof(command));
+        close(domain->sockets[k]);
+        waitpid(domain->pids[k], NULL, 0);
+    }
+    munmap(domain->shared, domain->shared_size);
+    mem_free(domain);
+}
+
+// Sends a command to every worker, which run it side by side, and waits
+// until all of them are done. False if a worker died.
+static bool run_command(domain_t *domain, command_t command)
+{
+    int c = command, done;
+    bool ok = true;
+    for (int k = 0; k < domain->num_workers; k++)
+        ok &= write_full(domain->sockets[k], &c, sizeof(c));
+    for (int k = 0; k < domain->num_workers; k++)
+        ok &= read_full(domain->sockets[k], &done, sizeof(done));
+    return ok;
+}
+
+// Grid over the charges, with about CHARGES_PER_CELL charges per cell,
+// narrower where needed for COLUMNS_PER_WORKER columns per worker, and the
+// owner of each column. It stops 4 standard deviations away from
+// the mean position, so that a few charges thrown far away don't squeeze
+// all the others in one column: they go to the cells of the edges.
+static void set_grid(domain_t *domain)
+{
+    domain_shared_t *s = domain->shared;
+    double x0 = INFINITY, x1 = -INFINITY, y0 = INFINITY, y1 = -INFINITY;
+    double sx = 0, sxx = 0, sy = 0, syy = 0;
+    int n = 0;
+    for (int k = 0; k < domain->num_workers; k++)
+    {
+        if (s->count[k] == 0)
+            continue;
+        x0 = fmin(x0, s->min_x[k]);
+        x1 = fmax(x1, s->max_x[k]);
+        y0 = fmin(y0, s->min_y[k]);
+        y1 = fmax(y1, s->max_y[k]);
+        sx += s->sum_x[k];
+        sxx += s->sum_xx[k];
+        sy += s->sum_y[k];
+        syy += s->sum_yy[k];
+        n += s->count[k];
+    }
+    if (n == 0)
+        x0 = x1 = y0 = y1 = 0;
+    else
+    {
+        double mx = sx / n, my = sy / n;
+        double spread_x = 4 * sqrt(fmax(sxx / n - mx * mx, 0)), spread_y = 4 * sqrt(fmax(syy / n - my * my, 0));
+        x0 = fmax(x0, mx - spread_x);
+        x1 = fmin(x1, mx + spread_x);
+        y0 = fmax(y0, my - spread_y);
+        y1 = fmin(y1, my + spread_y);
+    }
+    double w = x1 - x0, h = y1 - y0;
+    double cell = fmax(sqrt(w * h * CHARGES_PER_CELL / fmax(n, 1)), fmax(w, h) / (DOMAIN_MAX_SIDE - 1));
+    cell = cell > 0 ? cell : 1;
+    s->cell_width = fmin(cell, fmax(w / (COLUMNS_PER_WORKER * domain->num_workers), cell / COLUMNS_PER_WORKER));
+    s->cell_height = cell;
+    s->x0 = x0;
+    s->y0 = y0;
+    s->columns = (int)(w / s->cell_width) + 1;
+    s->rows = (int)(h / s->cell_height) + 1;
+    if (s->columns > DOMAIN_MAX_SIDE)
+        s->columns = DOMAIN_MAX_SIDE;
+    if (s->rows > DOMAIN_MAX_SIDE)
+        s->rows = DOMAIN_MAX_SIDE;
+    for (int c = 0, k = 0; c < s->columns; c++)
+    {
+        double center = s->x0 + (c + 0.5) * s->cell_width;
+        while (k + 1 < domain->num_workers && center >= s->bounds[k + 1])
+            k++;
+        s->owner[c] = k;
+    }
+}
+
+// Slab edges splitting the columns of the current grid into even counts
+static void rebalance(domain_t *domain, const int *histogram)
+{
+    domain_shared_t *s = domain->shared;
+    long n = 0;
+    for (int c = 0; c < s->columns; c++)
+        n += histogram[c];
+    for (int k = 0; k <= domain->num_workers; k++)
+        s->bounds[k] = k ? INFINITY : -INFINITY;
+    long sum = 0;
+    for (int c = 0, k = 1; c < s->columns && k < domain->num_workers; c++)
+    {
+        long before = sum;
+        sum += histogram[c];
+        // The edge of the column closest to the even split
+        for (; k < domain->num_workers && sum * domain->num_workers >= k * n; k++)
+        {
+            bool after = sum * domain->num_workers - k * n < k * n - before * domain->num_workers;
+            s->bounds[k] = s->x0 + (c + after) * s->cell_width;
+        }
+    }
+    domain->rebalances++;
+}
+
+// Hands the charges out to the workers, along even slabs
+bool domain_load(domain_t *domain, const charge_t *charges, int num_charges)
+{
+    if (num_charges > domain->capacity)
+        return false;
+    domain_shared_t *s = domain->shared;
+    memcpy(outbox(s, domain->capacity, domain->num_workers, 0), charges, num_charges * sizeof(charge_t));
+    for (int k = 0; k < domain->num_workers; k++)
+        s->count[k] = s->outgoing[k] = 0;
+    s->outgoing[0] = num_charges;
+
+    // The bounds of worker 0 stand for all the charges while they are in its outbox
+    set_bounds(s, 0, charges, num_charges);
+    s->count[0] = num_charges;
+    for (int k = 0; k <= domain->num_workers; k++)
+        s->bounds[k] = k ? INFINITY : -INFINITY;
+    set_grid(domain);
+    int histogram[DOMAIN_MAX_SIDE] = {0};
+    for (int i = 0; i < num_charges; i++)
+        histogram[column_of(s, charges[i].pos.x)]++;
+    rebalance(domain, histogram);
+    set_grid(domain);
+    s->count[0] = 0;
+    return run_command(domain, COMMAND_GATHER);
+}
+
+// One step of update_charges: every charge moves by dt times its force,
+// all of them computed before any moves
+bool domain_step(domain_t *domain, double dt)
+{
+    domain_shared_t *s = domain->shared;
+    s->dt = dt;
+    set_grid(domain);
+    if (!run_command(domain, COMMAND_MIGRATE))
+        return false;
+    for (int k = 0; k < domain->num_workers; k++)
+        domain->migrated += s->outgoing[k];
+    if (!run_command(domain, COMMAND_GATHER))
+        return false;
+
+    int n = 0, largest = 0;
+    for (int k = 0; k < domain->num_workers; k++)
+    {
+        n += s->count[k];
+        largest = s->count[k] > largest ? s->count[k] : largest;
+    }
+    domain->imbalance = n ? (double)largest * domain->num_workers / n : 1;
+    if (domain->imbalance > MAX_IMBALANCE)
+    {
+        // Takes effect at the migration of the next step
+        int histogram[DOMAIN_MAX_SIDE] = {0};
+        for (int k = 0; k < domain->num_workers; k++)
+            for (int c = 0; c < s->columns; c++)
+                histogram[c] += s->histogram[k][c];
+        rebalance(domain, histogram);
+    }
+
+    if (!run_command(domain, COMMAND_FORCES) || !run_command(domain, COMMAND_MOVE))
+        return false;
+    domain->steps++;
+    return true;
+}
+
+// Copies the charges of every slab to charges, returns their number.
+// The order is the one of the slabs, the ids tell the charges apart.
+int domain_gather(domain_t *domain, charge_t *charges)
+{
+    domain_shared_t *s = domain->shared;
+    int n = 0;
+    for (int k = 0; k < domain->num_workers; k++)
+    {
+        memcpy(charges + n, slab(s, domain->capacity, k), s->count[k] * sizeof(charge_t));
+        n += s->count[k];
+    }
+    return n;
+}
@@ -0,0 +1,65 @@
+#ifndef _DOMAIN_H_
+#define _DOMAIN_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "../charge/charge.h"
+
+// Spatial domain decomposition of update_charges over worker processes.
+// Each worker owns a vertical slab of columns of a grid laid over the
+// charges. The slabs live in a shared memory mapping that every worker
+// reads from, and the workers are driven in lock step over Unix sockets.
+// A step moves every charge by dt times the force of update_charges:
+// pair by pair with the charges of the cells close to its own, the halo
+// a worker reads from the slabs next to it, and from the multipoles of
+// the cells further away, up to the quadrupole.
+// Charges that crossed into another slab migrate to its worker, and the
+// slabs are moved to even out the counts when they drifted apart.
+
+#define DOMAIN_MAX_WORKERS 64
+#define DOMAIN_MAX_SIDE 256 // Cells per side of the grid
+
+// Two cells are summed through their multipoles when their centers are
+// further apart than the sum of their radii over this
+#define DOMAIN_OPENING 0.6
+
+// Multipoles of the charges of a cell about the center of their bounding
+// box, and where the charges are in the slab of the worker owning the column
+typedef struct
+{
+    vec2 center;
+    double radius;          // Distance from the center to the furthest charge
+    double q;
+    double px, py;          // Dipole
+    double mxx, mxy, myy;   // Second moments
+    int start;
+    int count;
+} domain_cell_t;
+
+typedef struct _domain_shared domain_shared_t;
+
+typedef struct
+{
+    int num_workers;
+    int capacity;           // Charges the mapping has room for
+    pid_t pids[DOMAIN_MAX_WORKERS];
+    int sockets[DOMAIN_MAX_WORKERS];
+    domain_shared_t *shared;
+    size_t shared_size;
+    long steps;
+    int rebalances;         // Times the slabs were moved
+    long migrated;          // Charges that changed worker, over all the steps
+    double imbalance;       // Largest slab count over the mean, at the last step
+} domain_t;
+
+domain_t *domain_create(int num_workers, int capacity);
+
+void domain_destroy(domain_t *domain);
+
+bool domain_load(domain_t *domain, const charge_t *charges, int num_charges);
+
+bool domain_step(domain_t *domain, double dt);
+
+int domain_gather(domain_t *domain, charge_t *charges);
+
+#endif
@@ -0,0 +1,242 @@
+#include <math.h>
+#include <string.h>
+#include "dynamics.h"
+#include "../rng/rng.h"
+
+// dt is never lowered below max_dt times this, the run is aborted instead
+#define MIN_DT_FACTOR 1e-6
+
+// Clean steps before a lowered dt is doubled again
+#define RECOVERY_STEPS 100
+
+dynamics_t dynamics_create(integrator_t integrator, double dt, uint64_t seed)
+{
+    dynamics_t dyn = {
+        .integrator = integrator,
+        .thermostat = THERMOSTAT_NONE,
+        .dt = dt,
+        .max_dt = dt,
+        .coupling_time = 100 * dt,
+        .report_every = 30,
+        .max_displacement = INFINITY,
+        .max_drift = 0.1,
+        .seed = seed,
+    };
+    return dyn;
+}
+
+void dynamics_free(dynamics_t *dyn)
+{
+    mem_free(dyn->forces);
+}
+
+// Forget the kept forces and the energy reference, e.g. once charges were removed
+void dynamics_reset(dynamics_t *dyn)
+{
+    dyn->forces_count = 0;
+    dyn->has_reference = false;
+    dyn->aborted = false;
+    dyn->dt = dyn->max_dt;
+}
+
+// The charges were reordered, the charge now at k was at order[k]
+void dynamics_permute(dynamics_t *dyn, const int *order, int num_charges, arena_t *arena)
+{
+    if (dyn->forces_count != num_charges)
+        return;
+    vec2 *forces = arena_alloc(arena, num_charges * sizeof(vec2));
+    for (int k = 0; k < num_charges; k++)
+        forces[k] = dyn->forces[order[k]];
+    memcpy(dyn->forces, forces, num_charges * sizeof(vec2));
+}
+
+// The pairwise sums of update_charges
+static void direct_solver(void *user, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy)
+{
+    (void)user;
+    compute_forces(charges, num_charges, forces, energy, arena);
+}
+
+// -Ofast assumes there are no infinities nor NaNs, so isfinite cannot be trusted
+static bool is_finite(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits >> 52 & 0x7ff) != 0x7ff;
+}
+
+// Largest distance a charge moved from before, infinite if one left the numbers
+static double largest_displacement(charge_t *before, charge_t *after, int num_charges)
+{
+    double largest = 0;
+#pragma omp parallel for schedule(static) reduction(max : largest)
+    for (int i = 0; i < num_charges; i++)
+    {
+        double d = vec2_norm(vec2_sub(after[i].pos, before[i].pos));
+        if (!is_finite(d) || !is_finite(after[i].vel.x) || !is_finite(after[i].vel.y))
+            d = INFINITY;
+        largest = fmax(largest, d);
+    }
+    return largest;
+}
+
+static double kinetic_energy(charge_t *charges, int num_charges)
+{
+    double kinetic = 0;
+    for (int i = 0; i < num_charges; i++)
+        kinetic += 0.5 * vec2_norm_sqr(charges[i].vel);
+    return kinetic;
+}
+
+static void apply_thermostat(dynamics_t *dyn, charge_t *charges, int num_charges)
+{
+    double dt = dyn->dt;
+    if (dyn->thermostat == THERMOSTAT_LANGEVIN)
+    {
+        // Exact Ornstein-Uhlenbeck step, drawn from the step and charge index only
+        double decay = exp(-dyn->damping * dt);
+        double kick = sqrt(dyn->temperature * (1 - decay * decay));
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < num_charges; i++)
+        {
+            rng_t rng = rng_create(dyn->seed, RNG_STREAM_THERMOSTAT, (uint64_t)dyn->step << 32 | i);
+            vec2 noise = vec2_create(rng_normal(&rng), rng_normal(&rng));
+            charges[i].vel = vec2_add(vec2_mul(decay, charges[i].vel), vec2_mul(kick, noise));
+        }
+        return;
+    }
+
+    double scale = exp(-dyn->damping * dt);
+    if (dyn->thermostat == THERMOSTAT_BERENDSEN)
+    {
+        // Two degrees of freedom and unit masses, the temperature is the kinetic energy per charge
+        double current = kinetic_energy(charges, num_charges) / num_charges;
+        if (current > 0)
+            scale *= sqrt(fmin(1.25 * 1.25, fmax(0.8 * 0.8, 1 + dt / dyn->coupling_time * (dyn->temperature / current - 1))));
+    }
+    if (scale != 1)
+        for (int i = 0; i < num_charges; i++)
+            charges[i].vel = vec2_mul(scale, charges[i].vel);
+}
+
+static void advance(dynamics_t *dyn, force_solver_t solver, void *user, arena_t *arena, charge_t *charges, int num_charges, double *energy)
+{
+    double dt = dyn->dt;
+    if (dyn->integrator == INTEGRATOR_OVERDAMPED)
+    {
+        vec2 *forces = arena_alloc(arena, num_charges * sizeof(vec2));
+        solver(user, arena, charges, num_charges, forces, energy);
+        for (int i = 0; i < num_charges; i++)
+        {
+            charges[i].vel = forces[i];
+            charges[i].pos = vec2_add(charges[i].pos, vec2_mul(dt, forces[i]));
+        }
+        return;
+    }
+
+    if (dyn->forces_count != num_charges)
+    {
+        solver(user, arena, charges, num_charges, dyn->forces, NULL);
+        dyn->forces_count = num_charges;
+    }
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_charges; i++)
+    {
+        charges[i].vel = vec2_add(charges[i].vel, vec2_mul(0.5 * dt, dyn->forces[i]));
+        charges[i].pos = vec2_add(charges[i].pos, vec2_mul(dt, charges[i].vel));
+    }
+    solver(user, arena, charges, num_charges, dyn->forces, energy);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_charges; i++)
+        charges[i].vel = vec2_add(charges[i].vel, vec2_mul(0.5 * dt, dyn->forces[i]));
+    apply_thermostat(dyn, charges, num_charges);
+}
+
+static bool lower_dt(dynamics_t *dyn)
+{
+    dyn->dt *= 0.5;
+    dyn->dt_reductions++;
+    dyn->clean_steps = 0;
+    if (dyn->dt < dyn->max_dt * MIN_DT_FACTOR)
+        dyn->aborted = true;
+    return !dyn->aborted;
+}
+
+// Move the charges by one step of dyn->dt, with forces from the solver, or
+// from the pairwise sums of update_charges if it is NULL.
+// A step that moves a charge further than max_displacement, or out of the
+// finite numbers, is undone and taken again with half the dt. Without
+// damping nor thermostat, the inertial integrator also halves dt when the
+// total energy drifts by more than max_drift.
+// Every report_every steps the energies and the momentum are reported,
+// those of the state the step started from with the overdamped integrator.
+// Returns false once the run was aborted.
+bool dynamics_step(dynamics_t *dyn, force_solver_t solver, void *user, arena_t *arena, charge_t *charges, int num_charges)
+{
+    if (dyn->aborted)
+        return false;
+    if (num_charges == 0)
+        return true;
+    if (!solver)
+        solver = direct_solver;
+    if (num_charges > dyn->forces_capacity)
+    {
+        dyn->forces = mem_realloc(dyn->forces, num_charges * sizeof(vec2));
+        dyn->forces_capacity = num_charges;
+        dyn->forces_count = 0;
+    }
+
+    bool report = dyn->report_every > 0 && dyn->step % dyn->report_every == 0;
+    charge_t *before = arena_alloc(arena, num_charges * sizeof(charge_t));
+    vec2 *forces_before = arena_alloc(arena, num_charges * sizeof(vec2));
+    memcpy(before, charges, num_charges * sizeof(charge_t));
+    memcpy(forces_before, dyn->forces, num_charges * sizeof(vec2));
+    int forces_count_before = dyn->forces_count;
+
+    double potential = 0;
+    while (true)
+    {
+        advance(dyn, solver, user, arena, charges, num_charges, report ? &potential : NULL);
+        if (largest_displacement(before, charges, num_charges) <= dyn->max_displacement && is_finite(potential))
+            break;
+        memcpy(charges, before, num_charges * sizeof(charge_t));
+        memcpy(dyn->forces, forces_before, num_charges * sizeof(vec2));
+        dyn->forces_count = forces_count_before;
+        if (!lower_dt(dyn))
+            return false;
+    }
+
+    if (report)
+    {
+        energy_report_t *r = &dyn->report;
+        r->step = dyn->step;
+        r->kinetic = kinetic_energy(charges, num_charges);
+        r->potential = potential;
+        r->total = r->kinetic + r->potential;
+        r->momentum = vec2_create(0, 0);
+        for (int i = 0; i < num_charges; i++)
+            r->momentum = vec2_add(r->momentum, charges[i].vel);
+
+        bool conservative = dyn->integrator == INTEGRATOR_INERTIAL && dyn->thermostat == THERMOSTAT_NONE && dyn->damping == 0;
+        if (!dyn->has_reference || !conservative)
+        {
+            dyn->reference = *r;
+            dyn->has_reference = true;
+        }
+        else if (fabs(r->total - dyn->reference.total) > dyn->max_drift * fabs(dyn->reference.total))
+        {
+            // The step is fine, but dt is too large for the energy to hold
+            if (!lower_dt(dyn))
+                return false;
+            dyn->reference = *r;
+        }
+    }
+
+    dyn->step++;
+    if (++dyn->clean_steps >= RECOVERY_STEPS && dyn->dt < dyn->max_dt)
+    {
+        dyn->dt = fmin(dyn->max_dt, 2 * dyn->dt);
+        dyn->clean_steps = 0;
+    }
+    return true;
+}
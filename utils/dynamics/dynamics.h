@@ -0,0 +1,72 @@
+#ifndef _DYNAMICS_H_
+#define _DYNAMICS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../memory/memory.h"
+
+// Forces on every charge, and the potential energy when energy is not NULL.
+// pic_forces and p3m_forces have this signature.
+typedef void (*force_solver_t)(void *user, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy);
+
+typedef enum
+{
+    INTEGRATOR_OVERDAMPED, // Charges move along the force, as update_charges does
+    INTEGRATOR_INERTIAL    // Velocity Verlet with unit masses
+} integrator_t;
+
+typedef enum
+{
+    THERMOSTAT_NONE,
+    THERMOSTAT_BERENDSEN, // Velocities rescaled towards the temperature
+    THERMOSTAT_LANGEVIN   // Friction and random kicks, damping is the friction
+} thermostat_t;
+
+// Energies and momentum of the charges at one step
+typedef struct
+{
+    long step;
+    double kinetic;
+    double potential;
+    double total;
+    vec2 momentum;
+} energy_report_t;
+
+typedef struct
+{
+    integrator_t integrator;
+    thermostat_t thermostat;
+    double dt;
+    double max_dt;           // dt grows back to it after a run of clean steps
+    double damping;          // Velocities decay as exp(-damping t)
+    double temperature;      // Kinetic energy per charge aimed at by the thermostats
+    double coupling_time;    // Relaxation time of the Berendsen thermostat
+    int report_every;        // Steps between energy reports, 0 for none
+    double max_displacement; // A step moving a charge further than this diverged
+    double max_drift;        // Relative drift of the total energy tolerated without damping nor thermostat
+    uint64_t seed;
+    long step;
+    int clean_steps;         // Steps since dt was last lowered
+    int dt_reductions;       // Times dt was lowered so far
+    bool aborted;            // dt went below the floor, the run cannot go on
+    energy_report_t report;    // Last report
+    energy_report_t reference; // First report since the last reset, drift is measured from it
+    bool has_reference;
+    vec2 *forces;            // Forces of the last step, kept by the inertial integrator
+    int forces_count;
+    int forces_capacity;
+} dynamics_t;
+
+dynamics_t dynamics_create(integrator_t integrator, double dt, uint64_t seed);
+
+void dynamics_free(dynamics_t *dyn);
+
+void dynamics_reset(dynamics_t *dyn);
+
+void dynamics_permute(dynamics_t *dyn, const int *order, int num_charges, arena_t *arena);
+
+bool dynamics_step(dynamics_t *dyn, force_solver_t solver, void *user, arena_t *arena, charge_t *charges, int num_charges);
+
+#endif
@@ -0,0 +1,70 @@
+#include <math.h>
+#include "fft.h"
+
+// Columns are transformed by blocks of this many, so that every butterfly
+// works on contiguous memory
+#define COLUMN_BLOCK 32
+
+// Transform `count` interleaved sequences of length n at once: element k of
+// sequence s is data[k * stride + s]
+static void fft_interleaved(double complex *data, int n, int stride, int count, bool inverse)
+{
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            for (int s = 0; s < count; s++)
+            {
+                double complex t = data[i * stride + s];
+                data[i * stride + s] = data[j * stride + s];
+                data[j * stride + s] = t;
+            }
+    }
+
+    for (int len = 2; len <= n; len <<= 1)
+    {
+        double angle = (inverse ? 2 : -2) * M_PI / len;
+        for (int k = 0; k < len / 2; k++)
+        {
+            double complex w = cexp(I * angle * k);
+            for (int start = 0; start < n; start += len)
+            {
+                double complex *a = data + (start + k) * stride;
+                double complex *b = data + (start + k + len / 2) * stride;
+                for (int s = 0; s < count; s++)
+                {
+                    double complex t = w * b[s];
+                    b[s] = a[s] - t;
+                    a[s] += t;
+                }
+            }
+        }
+    }
+
+    if (inverse)
+        for (int k = 0; k < n; k++)
+            for (int s = 0; s < count; s++)
+                data[k * stride + s] /= n;
+}
+
+void fft(double complex *data, int n, bool inverse)
+{
+    fft_interleaved(data, n, 1, 1, inverse);
+}
+
+void fft_2d(double complex *data, int width, int height, bool inverse)
+{
+#pragma omp parallel for schedule(static)
+    for (int row = 0; row < height; row++)
+        fft_interleaved(data + row * width, width, 1, 1, inverse);
+
+#pragma omp parallel for schedule(static)
+    for (int column = 0; column < width; column += COLUMN_BLOCK)
+    {
+        int count = fmin(COLUMN_BLOCK, width - column);
+        fft_interleaved(data + column, height, width, count, inverse);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef _FFT_H_
+#define _FFT_H_
+
+#include <stdbool.h>
+#include <complex.h>
+
+// In-place radix-2 transforms, sizes must be powers of two.
+// The inverse transforms are scaled by 1/n, so that inverse(forward(x)) == x.
+
+void fft(double complex *data, int n, bool inverse);
+
+// Transform of a row-major width x height grid, rows then columns
+void fft_2d(double complex *data, int width, int height, bool inverse);
+
+#endif
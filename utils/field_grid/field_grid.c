@@ -0,0 +1,83 @@
+#include <math.h>
+#include "field_grid.h"
+#include "../memory/memory.h"
+
+void field_grid_init(field_grid_t *grid)
+{
+    grid->width = 0;
+    grid->height = 0;
+    grid->cell = 1;
+    grid->direction = NULL;
+    grid->magnitude = NULL;
+    grid->valid = NULL;
+    grid->capacity = 0;
+}
+
+void field_grid_free(field_grid_t *grid)
+{
+    mem_free(grid->direction);
+    mem_free(grid->magnitude);
+    mem_free(grid->valid);
+}
+
+// Sample the field every `cell` pixels over the screen, from the sampler or
+// if it is NULL from the charges
+void field_grid_update(field_grid_t *grid, camera_t *camera, double cell, charge_t *charges, int num_charges, field_sampler_t sampler, void *user)
+{
+    grid->cell = cell;
+    grid->width = (int)ceil(camera->width / cell) + 1;
+    grid->height = (int)ceil(camera->height / cell) + 1;
+    int nodes = grid->width * grid->height;
+    if (nodes > grid->capacity)
+    {
+        grid->direction = mem_realloc(grid->direction, nodes * sizeof(vec2));
+        grid->magnitude = mem_realloc(grid->magnitude, nodes * sizeof(float));
+        grid->valid = mem_realloc(grid->valid, nodes * sizeof(bool));
+        grid->capacity = nodes;
+    }
+
+    // The charges are summed for all the nodes at once, with the
+    // positions of the nodes turned into the field in place
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < grid->height; j++)
+        for (int i = 0; i < grid->width; i++)
+            grid->direction[j * grid->width + i] = camera_to_world(camera, i * cell, j * cell);
+    if (!sampler)
+        compute_total_e_batch(charges, num_charges, grid->direction, nodes, 1e-3, grid->direction, grid->valid);
+
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < nodes; k++)
+    {
+        vec2 e = grid->direction[k];
+        bool known = sampler ? sampler(user, e, &e) : grid->valid[k];
+        double norm = known ? vec2_norm(e) : 0;
+        grid->direction[k] = norm > 0 ? vec2_mul(1 / norm, e) : vec2_create(0, 0);
+        grid->magnitude[k] = norm;
+    }
+}
+
+// Direction of the field at a pixel, interpolated from the nodes around it.
+// Returns false outside of the grid or where the field is unknown.
+bool field_grid_direction(field_grid_t *grid, vec2 pixel, vec2 *direction)
+{
+    double fx = pixel.x / grid->cell, fy = pixel.y / grid->cell;
+    int i = floor(fx), j = floor(fy);
+    if (i < 0 || j < 0 || i + 1 >= grid->width || j + 1 >= grid->height)
+        return false;
+    double tx = fx - i, ty = fy - j;
+    // Spelled out rather than with vec2_*, this is called for every step
+    // of every streamline
+    vec2 *d = grid->direction + j * grid->width + i;
+    vec2 *below = d + grid->width;
+    double w00 = (1 - tx) * (1 - ty), w10 = tx * (1 - ty), w01 = (1 - tx) * ty, w11 = tx * ty;
+    double x = w00 * d[0].x + w10 * d[1].x + w01 * below[0].x + w11 * below[1].x;
+    double y = w00 * d[0].y + w10 * d[1].y + w01 * below[0].y + w11 * below[1].y;
+    double norm_sqr = x * x + y * y;
+    // Unknown nodes have no direction, and opposite ones cancel at sinks
+    if (norm_sqr < 1e-12)
+        return false;
+    double inverse = 1 / sqrt(norm_sqr);
+    direction->x = x * inverse;
+    direction->y = y * inverse;
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef _FIELD_GRID_H_
+#define _FIELD_GRID_H_
+
+#include <stdbool.h>
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../camera/camera.h"
+
+// Field sampled on a regular grid of the screen, shared by the renderers
+// that need the field everywhere rather than along lines
+typedef struct
+{
+    int width; // Nodes, node (i, j) is at pixel (i * cell, j * cell)
+    int height;
+    double cell;     // Pixels between two nodes
+    vec2 *direction; // Unit direction of the field, zero where it is unknown
+    float *magnitude; // |E|, zero where it is unknown
+    bool *valid;      // Scratch for the validity of the batched evaluation
+    int capacity;
+} field_grid_t;
+
+void field_grid_init(field_grid_t *grid);
+
+void field_grid_free(field_grid_t *grid);
+
+void field_grid_update(field_grid_t *grid, camera_t *camera, double cell, charge_t *charges, int num_charges, field_sampler_t sampler, void *user);
+
+bool field_grid_direction(field_grid_t *grid, vec2 pixel, vec2 *direction);
+
+#endif
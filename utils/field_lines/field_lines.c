@@ -0,0 +1,568 @@
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "field_lines.h"
+
+#define OCCUPANCY_FREE -1
+#define OCCUPANCY_EXEMPT -2
+
+// Lines converge on charges, so they are allowed to get closer than the
+// separation within this many separations of a charge
+#define EXEMPT_RADIUS 2.5
+
+#define MAX_STEPS 10000
+
+// A line that moved less than STAGNATION_PROGRESS of its path over the
+// last STAGNATION_WINDOW steps is going back and forth
+#define STAGNATION_WINDOW 64
+#define STAGNATION_PROGRESS 0.25
+
+// A line closes on itself when it comes back within LOOP_DISTANCE steps of
+// its seed, after at least LOOP_MIN_STEPS steps
+#define LOOP_DISTANCE 2
+#define LOOP_MIN_STEPS 100
+
+// A change of the field since the last update, bounded by strength / distance(center)
+typedef struct
+{
+    vec2 center;
+    double strength;
+} perturbation_t;
+
+field_lines_t *field_lines_create(double tolerance)
+{
+    field_lines_t *fl = mem_calloc(1, sizeof(field_lines_t));
+    if (!fl)
+        return NULL;
+    fl->tolerance = tolerance;
+    charge_grid_init(&fl->charge_grid);
+    return fl;
+}
+
+void field_lines_destroy(field_lines_t *fl)
+{
+    mem_free(fl->lines);
+    mem_free(fl->points);
+    mem_free(fl->e_norms);
+    mem_free(fl->snapshot);
+    mem_free(fl->occupancy);
+    charge_grid_free(&fl->charge_grid);
+    mem_free(fl);
+}
+
+static void ensure_lines(field_lines_t *fl, int num_lines)
+{
+    if (num_lines <= fl->capacity)
+        return;
+    int capacity = fl->capacity ? fl->capacity : 64;
+    while (capacity < num_lines)
+        capacity *= 2;
+    fl->lines = mem_realloc(fl->lines, capacity * sizeof(field_line_t));
+    memset(fl->lines + fl->capacity, 0, (capacity - fl->capacity) * sizeof(field_line_t));
+    fl->capacity = capacity;
+}
+
+static void set_line(field_lines_t *fl, int i, vec2 seed, double dx, int owner, int source_line, int source_point)
+{
+    field_line_t *line = &fl->lines[i];
+    if (i >= fl->num_lines || line->dx != dx || line->owner != owner || !vec2_is_approx_equal(line->seed, seed, 1e-9))
+    {
+        line->seed = seed;
+        line->dx = dx;
+        line->owner = owner;
+        line->dirty = true;
+    }
+    line->source_line = source_line;
+    line->source_point = source_point;
+}
+
+// Lines keep the order of the seeds, so that the lines of an unchanged
+// seed are found again in the cache
+void field_lines_set_seeds(field_lines_t *fl, field_seed_t *seeds, int num_seeds)
+{
+    int num_lines = 0;
+    for (int i = 0; i < num_seeds; i++)
+        num_lines += seeds[i].dx == 0 ? 2 : 1;
+    ensure_lines(fl, num_lines);
+
+    int old_seed_lines = fl->num_seed_lines;
+    int n = 0;
+    for (int i = 0; i < num_seeds; i++)
+    {
+        int owner = n;
+        if (seeds[i].dx == 0)
+        {
+            set_line(fl, n++, seeds[i].pos, fl->fill_dx, owner, -1, 0);
+            set_line(fl, n++, seeds[i].pos, -fl->fill_dx, owner, -1, 0);
+        }
+        else
+        {
+            set_line(fl, n++, seeds[i].pos, seeds[i].dx, owner, -1, 0);
+        }
+    }
+
+    // Slots that held filled-in lines are now seed lines
+    for (int i = old_seed_lines; i < num_lines; i++)
+        fl->lines[i].dirty = true;
+
+    if (num_lines != old_seed_lines)
+    {
+        fl->num_lines = num_lines;
+        fl->refill = true;
+    }
+    fl->num_seed_lines = num_lines;
+}
+
+// separation: distance kept between lines, 0 traces every seed to the end
+// fill_dx: step of the lines seeded in the gaps, and of two-way seeds
+// max_lines: cap on the number of lines, filled-in ones included
+void field_lines_set_separation(field_lines_t *fl, double separation, double fill_dx, int max_lines)
+{
+    if (fl->separation != separation || fl->fill_dx != fill_dx || fl->max_lines != max_lines)
+        field_lines_invalidate(fl);
+    fl->separation = separation;
+    fl->fill_dx = fill_dx;
+    fl->max_lines = max_lines;
+}
+
+// Lines end when they get this close to a charge, 0 lets them run into it
+void field_lines_set_capture_radius(field_lines_t *fl, double capture_radius)
+{
+    if (fl->capture_radius != capture_radius)
+        field_lines_invalidate(fl);
+    fl->capture_radius = capture_radius;
+}
+
+// Lines follow the field given by the sampler instead of the exact sum over
+// the charges. The cache still watches the charges, the sampler is expected
+// to follow them.
+void field_lines_set_sampler(field_lines_t *fl, field_sampler_t sampler, void *user)
+{
+    if (fl->sampler != sampler || fl->sampler_data != user)
+        field_lines_invalidate(fl);
+    fl->sampler = sampler;
+    fl->sampler_data = user;
+}
+
+void field_lines_invalidate(field_lines_t *fl)
+{
+    for (int i = 0; i < fl->num_lines; i++)
+        fl->lines[i].dirty = true;
+}
+
+static int compare_offsets(const void *a, const void *b)
+{
+    return (*(field_line_t **)a)->offset - (*(field_line_t **)b)->offset;
+}
+
+// Move the points of the lines down to the start of the store, in order of
+// their offsets so that no line overwrites another
+static void compact_points(field_lines_t *fl)
+{
+    field_line_t **order = arena_alloc(fl->scratch, fl->num_lines * sizeof(field_line_t *));
+    int n = 0;
+    for (int i = 0; i < fl->num_lines; i++)
+        if (fl->lines[i].length > 0)
+            order[n++] = &fl->lines[i];
+    qsort(order, n, sizeof(field_line_t *), compare_offsets);
+
+    fl->points_used = 0;
+    for (int i = 0; i < n; i++)
+    {
+        memmove(fl->points + fl->points_used, fl->points + order[i]->offset, order[i]->length * sizeof(vec2));
+        memmove(fl->e_norms + fl->points_used, fl->e_norms + order[i]->offset, order[i]->length * sizeof(double));
+        order[i]->offset = fl->points_used;
+        fl->points_used += order[i]->length;
+    }
+}
+
+// Make room for a whole line at the end of the point store.
+// Retraced lines are appended, so the store fills up with dead points and
+// is compacted, and only grows when the live points no longer fit.
+static void reserve_points(field_lines_t *fl)
+{
+    if (fl->points_used + MAX_STEPS <= fl->points_capacity)
+        return;
+
+    compact_points(fl);
+    if (fl->points_used + MAX_STEPS > fl->points_capacity / 2)
+    {
+        fl->points_capacity = 2 * (fl->points_used + MAX_STEPS);
+        fl->points = mem_realloc(fl->points, fl->points_capacity * sizeof(vec2));
+        fl->e_norms = mem_realloc(fl->e_norms, fl->points_capacity * sizeof(double));
+    }
+    for (int i = 0; i < fl->num_lines; i++)
+    {
+        fl->lines[i].points = fl->points + fl->lines[i].offset;
+        fl->lines[i].e_norms = fl->e_norms + fl->lines[i].offset;
+    }
+}
+
+static void line_push(field_line_t *line, vec2 p, double e_norm)
+{
+    line->points[line->length] = p;
+    line->e_norms[line->length] = e_norm;
+    line->length++;
+
+    line->box_min = vec2_create(fmin(line->box_min.x, p.x), fmin(line->box_min.y, p.y));
+    line->box_max = vec2_create(fmax(line->box_max.x, p.x), fmax(line->box_max.y, p.y));
+    line->min_e = fmin(line->min_e, e_norm);
+}
+
+static int occupancy_cell(field_lines_t *fl, vec2 p)
+{
+    double cell = fl->separation / 2;
+    int column = (p.x - fl->x0) / cell;
+    int row = (p.y - fl->y0) / cell;
+    if (column < 0 || row < 0 || column >= fl->grid_width || row >= fl->grid_height)
+        return -1;
+    return row * fl->grid_width + column;
+}
+
+static void occupancy_reset(field_lines_t *fl, charge_t *charges, int num_charges)
+{
+    double cell = fl->separation / 2;
+    fl->grid_width = ceil((fl->x1 - fl->x0) / cell);
+    fl->grid_height = ceil((fl->y1 - fl->y0) / cell);
+    int size = fl->grid_width * fl->grid_height;
+    if (size > fl->grid_capacity)
+    {
+        fl->occupancy = mem_realloc(fl->occupancy, size * sizeof(int));
+        fl->grid_capacity = size;
+    }
+    for (int i = 0; i < size; i++)
+        fl->occupancy[i] = OCCUPANCY_FREE;
+
+    int radius = ceil(EXEMPT_RADIUS * fl->separation / cell);
+    for (int i = 0; i < num_charges; i++)
+    {
+        int c = occupancy_cell(fl, charges[i].pos);
+        if (c < 0)
+            continue;
+        int row = c / fl->grid_width, column = c % fl->grid_width;
+        for (int r = row - radius; r <= row + radius; r++)
+            for (int col = column - radius; col <= column + radius; col++)
+                if (r >= 0 && col >= 0 && r < fl->grid_height && col < fl->grid_width &&
+                    (r - row) * (r - row) + (col - column) * (col - column) <= radius * radius)
+                    fl->occupancy[r * fl->grid_width + col] = OCCUPANCY_EXEMPT;
+    }
+}
+
+// Claim the cell of p for owner.
+// Returns false if another line already went through it.
+static bool occupancy_claim(field_lines_t *fl, vec2 p, int owner)
+{
+    int c = occupancy_cell(fl, p);
+    if (c < 0 || fl->occupancy[c] == OCCUPANCY_EXEMPT)
+        return true;
+    if (fl->occupancy[c] == OCCUPANCY_FREE)
+        fl->occupancy[c] = owner;
+    return fl->occupancy[c] == owner;
+}
+
+// A seed is only placed where no line passes within a separation
+static bool occupancy_is_free(field_lines_t *fl, vec2 p)
+{
+    int c = occupancy_cell(fl, p);
+    if (c < 0 || fl->occupancy[c] == OCCUPANCY_EXEMPT)
+        return false;
+    int row = c / fl->grid_width, column = c % fl->grid_width;
+    for (int r = row - 1; r <= row + 1; r++)
+        for (int col = column - 1; col <= column + 1; col++)
+            if (r >= 0 && col >= 0 && r < fl->grid_height && col < fl->grid_width &&
+                fl->occupancy[r * fl->grid_width + col] >= 0)
+                return false;
+    return true;
+}
+
+static stop_reason_t integrate_line(field_lines_t *fl, field_line_t *line, charge_t *charges, int num_charges, int *steps)
+{
+    vec2 pos = line->seed;
+    vec2 anchor = pos;
+    double step = fabs(line->dx);
+    for (*steps = 0; *steps < MAX_STEPS; (*steps)++)
+    {
+        if (!(pos.x < fl->x1 && pos.x > fl->x0 && pos.y < fl->y1 && pos.y > fl->y0))
+            return STOP_LEFT;
+
+        vec2 e;
+        if (fl->sampler ? !fl->sampler(fl->sampler_data, pos, &e) : !compute_total_normalized_e(charges, num_charges, pos, 1e-3, &e))
+            return STOP_THRESHOLD;
+        if (fl->capture_radius > 0 && charge_grid_nearest(&fl->charge_grid, pos, fl->capture_radius) >= 0)
+            return STOP_CAPTURED;
+        if (fl->separation > 0 && !occupancy_claim(fl, pos, line->owner))
+            return STOP_OCCUPIED;
+
+        if (*steps % STAGNATION_WINDOW == 0)
+        {
+            if (*steps > 0 && vec2_norm(vec2_sub(pos, anchor)) < STAGNATION_PROGRESS * STAGNATION_WINDOW * step)
+                return STOP_STAGNATED;
+            anchor = pos;
+        }
+        if (*steps >= LOOP_MIN_STEPS && vec2_norm(vec2_sub(pos, line->seed)) < LOOP_DISTANCE * step)
+            return STOP_LOOPED;
+
+        double enorme = vec2_norm(e);
+        line_push(line, pos, enorme);
+        pos = vec2_add(pos, vec2_mul(line->dx / enorme, e));
+    }
+    return STOP_BUDGET;
+}
+
+// Same integration as draw_field_line, but the points are stored instead of drawn.
+// Lines also stop when they are captured by a charge, stagnate, close on
+// themselves, or, with a separation set, get too close to another line.
+static void trace_line(field_lines_t *fl, field_line_t *line, charge_t *charges, int num_charges)
+{
+    line->length = 0;
+    reserve_points(fl);
+    line->offset = fl->points_used;
+    line->points = fl->points + line->offset;
+    line->e_norms = fl->e_norms + line->offset;
+    line->box_min = vec2_create(INFINITY, INFINITY);
+    line->box_max = vec2_create(-INFINITY, -INFINITY);
+    line->min_e = INFINITY;
+    line->drift = 0;
+    line->dirty = false;
+
+    int steps;
+    stop_reason_t reason = integrate_line(fl, line, charges, num_charges, &steps);
+    fl->points_used += line->length;
+    fl->stats.steps += steps;
+    fl->stats.stops[reason]++;
+    if (reason == STOP_CAPTURED || reason == STOP_STAGNATED || reason == STOP_LOOPED)
+        fl->stats.saved += MAX_STEPS - steps;
+}
+
+// Jobard-Lefer placement: walk the lines in order and seed a new pair of
+// lines one separation away on each side, wherever the space is still empty
+static void fill_gaps(field_lines_t *fl, charge_t *charges, int num_charges, int from_line, int from_point)
+{
+    int stride = fmax(1, round(fl->separation / fabs(fl->fill_dx)));
+    for (int l = from_line; l < fl->num_lines && fl->num_lines + 2 <= fl->max_lines; l++)
+    {
+        for (int j = l == from_line ? from_point : 0; j + 1 < fl->lines[l].length && fl->num_lines + 2 <= fl->max_lines; j += stride)
+        {
+            vec2 p = fl->lines[l].points[j];
+            vec2 tangent = vec2_normalize(vec2_sub(fl->lines[l].points[j + 1], p));
+            vec2 normal = vec2_create(-tangent.y, tangent.x);
+            for (int side = -1; side <= 1; side += 2)
+            {
+                vec2 seed = vec2_add(p, vec2_mul(side * fl->separation, normal));
+                if (!occupancy_is_free(fl, seed))
+                    continue;
+                int n = fl->num_lines;
+                ensure_lines(fl, n + 2);
+                fl->num_lines = n + 2;
+                set_line(fl, n, seed, fl->fill_dx, n, l, j);
+                set_line(fl, n + 1, seed, -fl->fill_dx, n, l, j);
+                fl->lines[n].dirty = fl->lines[n + 1].dirty = true;
+                trace_line(fl, &fl->lines[n], charges, num_charges);
+                trace_line(fl, &fl->lines[n + 1], charges, num_charges);
+                fl->retraced += 2;
+            }
+        }
+    }
+}
+
+// Lines of an evenly spaced set stop on the lines traced before them, so
+// everything after the first dirty line has to be grown again
+static void update_evenly_spaced(field_lines_t *fl, charge_t *charges, int num_charges)
+{
+    int first = 0;
+    while (first < fl->num_lines && !fl->lines[first].dirty)
+        first++;
+    if (first == fl->num_lines && !fl->refill)
+        return;
+    fl->refill = false;
+
+    int from_line = 0, from_point = 0;
+    if (first < fl->num_seed_lines)
+    {
+        fl->num_lines = fl->num_seed_lines;
+    }
+    else if (first < fl->num_lines)
+    {
+        first = fl->lines[first].owner;
+        from_line = fl->lines[first].source_line;
+        from_point = fl->lines[first].source_point;
+        fl->num_lines = first;
+    }
+
+    occupancy_reset(fl, charges, num_charges);
+    for (int i = 0; i < first; i++)
+        for (int j = 0; j < fl->lines[i].length; j++)
+            occupancy_claim(fl, fl->lines[i].points[j], fl->lines[i].owner);
+
+    for (int i = first; i < fl->num_lines; i++)
+    {
+        trace_line(fl, &fl->lines[i], charges, num_charges);
+        fl->retraced++;
+    }
+    fill_gaps(fl, charges, num_charges, from_line, from_point);
+}
+
+static double distance_to_box(vec2 p, vec2 box_min, vec2 box_max)
+{
+    double dx = fmax(fmax(box_min.x - p.x, 0), p.x - box_max.x);
+    double dy = fmax(fmax(box_min.y - p.y, 0), p.y - box_max.y);
+    return sqrt(dx * dx + dy * dy);
+}
+
+// Upper bound of the relative field change along the line.
+// The whole line is bounded by its box first, and is only walked point
+// by point when the box is too close to one of the perturbations.
+static double line_error(field_line_t *line, perturbation_t *perturbations, int num_perturbations, double budget)
+{
+    double bound = 0;
+    for (int k = 0; k < num_perturbations; k++)
+        bound += perturbations[k].strength / distance_to_box(perturbations[k].center, line->box_min, line->box_max);
+    bound /= line->min_e;
+    if (bound <= budget)
+        return bound;
+
+    double worst = 0;
+    for (int j = 0; j < line->length; j++)
+    {
+        double delta = 0;
+        for (int k = 0; k < num_perturbations; k++)
+            delta += perturbations[k].strength / vec2_norm(vec2_sub(line->points[j], perturbations[k].center));
+        double error = delta / line->e_norms[j];
+        if (error > worst)
+        {
+            worst = error;
+            if (worst > budget)
+                break;
+        }
+    }
+    return worst;
+}
+
+// The first num_charges charges were reordered, the one now at k was at
+// order[k]. The snapshot follows so that the lines don't see an edit.
+void field_lines_permute(field_lines_t *fl, const int *order, int num_charges, arena_t *arena)
+{
+    if (num_charges > fl->snapshot_count)
+        return;
+    charge_t *snapshot = arena_alloc(arena, num_charges * sizeof(charge_t));
+    for (int k = 0; k < num_charges; k++)
+        snapshot[k] = fl->snapshot[order[k]];
+    memcpy(fl->snapshot, snapshot, num_charges * sizeof(charge_t));
+}
+
+// compute_e gives |E| = K / (|q| r), so a charge edit changes the field
+// at a distance r by at most strength / r
+static int collect_perturbations(field_lines_t *fl, charge_t *charges, int num_charges, perturbation_t *out)
+{
+    int n = 0;
+    for (int i = 0; i < num_charges; i++)
+    {
+        if (i >= fl->snapshot_count)
+        {
+            out[n++] = (perturbation_t){charges[i].pos, K / fabs(charges[i].q)};
+            continue;
+        }
+
+        charge_t old = fl->snapshot[i];
+        if (old.q == charges[i].q && old.pos.x == charges[i].pos.x && old.pos.y == charges[i].pos.y)
+            continue;
+
+        if (old.pos.x == charges[i].pos.x && old.pos.y == charges[i].pos.y)
+        {
+            out[n++] = (perturbation_t){charges[i].pos, K * fabs(1 / charges[i].q - 1 / old.q)};
+        }
+        else
+        {
+            out[n++] = (perturbation_t){old.pos, K / fabs(old.q)};
+            out[n++] = (perturbation_t){charges[i].pos, K / fabs(charges[i].q)};
+        }
+    }
+    return n;
+}
+
+void field_lines_update(field_lines_t *fl, arena_t *arena, charge_t *charges, int num_charges, double x0, double x1, double y0, double y1)
+{
+    if (num_charges < fl->snapshot_count || x0 != fl->x0 || x1 != fl->x1 || y0 != fl->y0 || y1 != fl->y1)
+    {
+        field_lines_invalidate(fl);
+        fl->snapshot_count = 0;
+    }
+    fl->x0 = x0;
+    fl->x1 = x1;
+    fl->y0 = y0;
+    fl->y1 = y1;
+
+    if (num_charges > 0)
+    {
+        perturbation_t *perturbations = arena_alloc(arena, 2 * num_charges * sizeof(perturbation_t));
+        int num_perturbations = collect_perturbations(fl, charges, num_charges, perturbations);
+
+        // Estimating costs as much as retracing once most of the charges moved
+        if (num_perturbations > num_charges)
+        {
+            field_lines_invalidate(fl);
+        }
+        else if (num_perturbations > 0)
+        {
+            for (int i = 0; i < fl->num_lines; i++)
+            {
+                field_line_t *line = &fl->lines[i];
+                if (line->dirty)
+                    continue;
+                // Nothing to bound an empty line with, it is cheap to retrace anyway
+                if (line->length == 0)
+                {
+                    line->dirty = line->seed.x > x0 && line->seed.x < x1 && line->seed.y > y0 && line->seed.y < y1;
+                    continue;
+                }
+                line->drift += line_error(line, perturbations, num_perturbations, fl->tolerance - line->drift);
+                if (line->drift > fl->tolerance)
+                    line->dirty = true;
+            }
+        }
+    }
+
+    fl->scratch = arena;
+    fl->retraced = 0;
+    memset(&fl->stats, 0, sizeof(trace_stats_t));
+    if (fl->capture_radius > 0)
+        charge_grid_build(&fl->charge_grid, charges, num_charges, 2 * fl->capture_radius);
+    if (fl->separation > 0)
+    {
+        update_evenly_spaced(fl, charges, num_charges);
+    }
+    else
+    {
+        for (int i = 0; i < fl->num_lines; i++)
+        {
+            if (!fl->lines[i].dirty)
+                continue;
+            trace_line(fl, &fl->lines[i], charges, num_charges);
+            fl->retraced++;
+        }
+    }
+
+    if (num_charges > fl->snapshot_capacity)
+    {
+        fl->snapshot = mem_realloc(fl->snapshot, num_charges * sizeof(charge_t));
+        fl->snapshot_capacity = num_charges;
+    }
+    memcpy(fl->snapshot, charges, num_charges * sizeof(charge_t));
+    fl->snapshot_count = num_charges;
+}
+
+// Lines add their density to the buffer, dense bundles build up instead
+// of being painted over
+void field_lines_draw(density_buffer_t *db, camera_t *camera, field_lines_t *fl)
+{
+    for (int i = 0; i < fl->num_lines; i++)
+    {
+        field_line_t *line = &fl->lines[i];
+        for (int j = 0; j + 1 < line->length; j++)
+        {
+            vec2 a = camera_to_pixel(camera, line->points[j]);
+            vec2 b = camera_to_pixel(camera, line->points[j + 1]);
+            density_add_segment(db, a.x, a.y, b.x, b.y, 1);
+        }
+    }
+}
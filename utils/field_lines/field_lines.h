@@ -0,0 +1,115 @@
+#ifndef _FIELD_LINES_H_
+#define _FIELD_LINES_H_
+
+#include <stdbool.h>
+#include "../vec2/vec2.h"
+#include "../gfx/gfx.h"
+#include "../charge/charge.h"
+#include "../charge_grid/charge_grid.h"
+#include "../memory/memory.h"
+#include "../camera/camera.h"
+#include "../density/density.h"
+
+// Where a field line starts.
+// A seed with dx == 0 gives two lines, one in each direction.
+typedef struct
+{
+    vec2 pos;
+    double dx;
+} field_seed_t;
+
+// Why the tracing of a line stopped
+typedef enum
+{
+    STOP_LEFT,      // Left the traced region
+    STOP_BUDGET,    // Ran out of steps
+    STOP_THRESHOLD, // compute_total_normalized_e or the sampler refused the point
+    STOP_OCCUPIED,  // Came too close to another line
+    STOP_CAPTURED,  // Reached the capture radius of a charge
+    STOP_STAGNATED, // Stopped making progress, e.g. oscillating
+    STOP_LOOPED,    // Came back to its seed
+    STOP_COUNT
+} stop_reason_t;
+
+// Tracing statistics of one update
+typedef struct
+{
+    long steps;            // Integration steps taken
+    long saved;            // Steps left unspent by lines stopped early
+    int stops[STOP_COUNT]; // Number of lines stopped for each reason
+} trace_stats_t;
+
+// A traced field line kept between frames
+typedef struct
+{
+    vec2 seed;
+    double dx;        // Signed integration step, the sign selects the direction
+    int owner;        // Index of the first line sharing the same seed
+    int source_line;  // Line and point a filled-in line was seeded from, -1 for seeds
+    int source_point;
+    vec2 *points;     // Points of the line, in tracing order
+    double *e_norms;  // |E| at each point, used to estimate the error of an edit
+    int offset;       // Position of the points in the shared point store
+    int length;
+    vec2 box_min;     // Bounding box of the region the line passed through
+    vec2 box_max;
+    double min_e;     // Smallest |E| met along the line
+    double drift;     // Relative field change accumulated since the last trace
+    bool dirty;
+} field_line_t;
+
+// Cache of field lines, retraced only when an edit of the charges
+// changed the field near their path by more than `tolerance`
+typedef struct
+{
+    field_line_t *lines;
+    int num_lines;
+    int capacity;
+    charge_t *snapshot; // Charges as they were at the last update
+    int snapshot_count;
+    int snapshot_capacity;
+    vec2 *points;       // Point store shared by all the lines
+    double *e_norms;
+    int points_used;
+    int points_capacity;
+    arena_t *scratch;   // Arena of the update in progress
+    double x0, x1, y0, y1;
+    double tolerance;
+    int num_seed_lines; // Lines coming from the seeds, the next ones fill the gaps
+    double separation;  // Distance kept between lines, 0 disables even spacing
+    double fill_dx;     // Step of the lines filling the gaps
+    int max_lines;
+    bool refill;        // The seed lines changed in number, gaps must be filled again
+    int *occupancy;     // Owner of each cell, or one of the OCCUPANCY_* values
+    int grid_width;
+    int grid_height;
+    int grid_capacity;
+    double capture_radius; // Lines end this close to a charge
+    charge_grid_t charge_grid;
+    field_sampler_t sampler; // NULL to sum the field of the charges
+    void *sampler_data;
+    int retraced; // Number of lines retraced by the last update
+    trace_stats_t stats;
+} field_lines_t;
+
+field_lines_t *field_lines_create(double tolerance);
+
+void field_lines_destroy(field_lines_t *fl);
+
+void field_lines_set_seeds(field_lines_t *fl, field_seed_t *seeds, int num_seeds);
+
+void field_lines_set_separation(field_lines_t *fl, double separation, double fill_dx, int max_lines);
+
+void field_lines_set_capture_radius(field_lines_t *fl, double capture_radius);
+
+void field_lines_set_sampler(field_lines_t *fl, field_sampler_t sampler, void *user);
+
+void field_lines_invalidate(field_lines_t *fl);
+
+void field_lines_permute(field_lines_t *fl, const int *order, int num_charges, arena_t *arena);
+
+void field_lines_update(field_lines_t *fl, arena_t *arena, charge_t *charges, int num_charges, double x0, double x1, double y0, double y1);
+
+void field_lines_draw(density_buffer_t *db, camera_t *camera, field_lines_t *fl);
+
+#endif
@@ -0,0 +1,318 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "field_shm.h"
+#include "../memory/memory.h"
+
+// Room for charges in a new segment, it grows by doubling
+#define INITIAL_CHARGES 1024
+
+// Pairs of a charge and a point evaluated under one read of the sequence,
+// about a millisecond: much shorter than a frame, so that most reads
+// complete before the engine publishes again
+#define BATCH_PAIRS (1 << 20)
+
+static size_t segment_size(int charge_capacity, int grid_capacity)
+{
+    return sizeof(field_shm_header_t) + (size_t)charge_capacity * sizeof(charge_t) + (size_t)grid_capacity * (sizeof(vec2) + sizeof(float));
+}
+
+static charge_t *segment_charges(const field_shm_header_t *header)
+{
+    return (charge_t *)(header + 1);
+}
+
+static vec2 *segment_directions(const field_shm_header_t *header, int charge_capacity)
+{
+    return (vec2 *)(segment_charges(header) + charge_capacity);
+}
+
+static float *segment_magnitudes(const field_shm_header_t *header, int charge_capacity, int grid_capacity)
+{
+    return (float *)(segment_directions(header, charge_capacity) + grid_capacity);
+}
+
+// Creates the segment, replacing a segment of the same name left over by
+// an engine that crashed. Returns NULL if it cannot be created.
+field_shm_t *field_shm_create(const char *name)
+{
+    field_shm_t *shm = mem_calloc(1, sizeof(field_shm_t));
+    if (!shm)
+        return NULL;
+    snprintf(shm->name, sizeof(shm->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    shm->fd = shm_open(shm->name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    shm->size = segment_size(INITIAL_CHARGES, 0);
+    if (shm->fd < 0 || ftruncate(shm->fd, shm->size) != 0)
+    {
+        if (shm->fd >= 0)
+        {
+            close(shm->fd);
+            shm_unlink(shm->name);
+        }
+        mem_free(shm);
+        return NULL;
+    }
+    shm->header = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (shm->header == MAP_FAILED)
+    {
+        close(shm->fd);
+        shm_unlink(shm->name);
+        mem_free(shm);
+        return NULL;
+    }
+    shm->header->magic = FIELD_SHM_MAGIC;
+    shm->header->version = FIELD_SHM_VERSION;
+    shm->header->charge_capacity = INITIAL_CHARGES;
+    return shm;
+}
+
+// Clients that have the segment open keep reading the last frame
+void field_shm_destroy(field_shm_t *shm)
+{
+    munmap(shm->header, shm->size);
+    close(shm->fd);
+    shm_unlink(shm->name);
+    mem_free(shm);
+}
+
+// Grows the segment, which moves the grid after the charges. Only called
+// with the sequence odd: the clients notice the new capacities once it is
+// even again and map the segment anew.
+static bool grow(field_shm_t *shm, int num_charges, int grid_nodes)
+{
+    field_shm_header_t *header = shm->header;
+    int charge_capacity = header->charge_capacity, grid_capacity = header->grid_capacity;
+    while (charge_capacity < num_charges)
+        charge_capacity *= 2;
+    if (grid_capacity < grid_nodes)
+        grid_capacity = grid_nodes;
+    size_t size = segment_size(charge_capacity, grid_capacity);
+    if (ftruncate(shm->fd, size) != 0)
+        return false;
+    field_shm_header_t *grown = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (grown == MAP_FAILED)
+        return false;
+    munmap(shm->header, shm->size);
+    shm->header = grown;
+    shm->size = size;
+    grown->charge_capacity = charge_capacity;
+    grown->grid_capacity = grid_capacity;
+    return true;
+}
+
+// Writes a new frame: the charges the field comes from, and the grid when
+// it is not NULL. Never waits for the clients. Returns false when the
+// segment could not grow to fit, the previous frame stays published.
+bool field_shm_publish(field_shm_t *shm, const charge_t *charges, int num_charges, const camera_t *camera, const field_grid_t *grid)
+{
+    int grid_nodes = grid ? grid->width * grid->height : 0;
+    uint64_t sequence = shm->header->sequence;
+    __atomic_store_n(&shm->header->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    bool fits = num_charges <= shm->header->charge_capacity && grid_nodes <= shm->header->grid_capacity;
+    if (fits || grow(shm, num_charges, grid_nodes))
+    {
+        field_shm_header_t *header = shm->header;
+        memcpy(segment_charges(header), charges, num_charges * sizeof(charge_t));
+        header->num_charges = num_charges;
+        header->camera = *camera;
+        header->grid_width = grid ? grid->width : 0;
+        header->grid_height = grid ? grid->height : 0;
+        header->grid_cell = grid ? grid->cell : 1;
+        if (grid)
+        {
+            memcpy(segment_directions(header, header->charge_capacity), grid->direction, grid_nodes * sizeof(vec2));
+            memcpy(segment_magnitudes(header, header->charge_capacity, header->grid_capacity), grid->magnitude, grid_nodes * sizeof(float));
+        }
+        header->frame++;
+        fits = true;
+    }
+
+    __atomic_store_n(&shm->header->sequence, sequence + 2, __ATOMIC_RELEASE);
+    return fits;
+}
+
+static bool map_client(field_shm_client_t *client)
+{
+    struct stat st;
+    if (fstat(client->fd, &st) != 0 || (size_t)st.st_size < sizeof(field_shm_header_t))
+        return false;
+    const field_shm_header_t *header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, client->fd, 0);
+    if (header == MAP_FAILED)
+        return false;
+    if (client->header)
+        munmap((void *)client->header, client->size);
+    client->header = header;
+    client->size = st.st_size;
+    return true;
+}
+
+// Opens the segment of a running engine, read only.
+// Returns NULL if there is none or it has another layout.
+field_shm_client_t *field_shm_open(const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    field_shm_client_t *client = mem_calloc(1, sizeof(field_shm_client_t));
+    if (!client)
+        return NULL;
+    client->fd = shm_open(path, O_RDONLY, 0);
+    if (client->fd < 0 || !map_client(client) || client->header->magic != FIELD_SHM_MAGIC || client->header->version != FIELD_SHM_VERSION)
+    {
+        field_shm_close(client);
+        return NULL;
+    }
+    return client;
+}
+
+void field_shm_close(field_shm_client_t *client)
+{
+    if (client->header)
+        munmap((void *)client->header, client->size);
+    if (client->fd >= 0)
+        close(client->fd);
+    mem_free(client);
+}
+
+// Waits for the engine to be out of a write and returns the sequence,
+// with the segment mapped whole. False if the engine stayed in the write.
+static bool begin_read(field_shm_client_t *client, uint64_t *sequence)
+{
+    for (int attempt = 0; attempt < FIELD_SHM_RETRIES; attempt++)
+    {
+        *sequence = __atomic_load_n(&client->header->sequence, __ATOMIC_ACQUIRE);
+        if (*sequence & 1)
+        {
+            usleep(100);
+            continue;
+        }
+        if (segment_size(client->header->charge_capacity, client->header->grid_capacity) <= client->size)
+            return true;
+        if (!map_client(client))
+            return false;
+    }
+    return false;
+}
+
+// Capacities of the segment, read once since the engine may be growing
+// it. False if they don't fit in the mapping, which only happens in a
+// read that end_read then refuses.
+static bool read_capacities(field_shm_client_t *client, int *charge_capacity, int *grid_capacity)
+{
+    *charge_capacity = __atomic_load_n(&client->header->charge_capacity, __ATOMIC_RELAXED);
+    *grid_capacity = __atomic_load_n(&client->header->grid_capacity, __ATOMIC_RELAXED);
+    return *charge_capacity >= 0 && *grid_capacity >= 0 && segment_size(*charge_capacity, *grid_capacity) <= client->size;
+}
+
+// True if nothing was written since begin_read, the data read in between
+// is then a consistent frame
+static bool end_read(field_shm_client_t *client, uint64_t sequence)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&client->header->sequence, __ATOMIC_RELAXED) != sequence)
+    {
+        client->retries++;
+        return false;
+    }
+    return true;
+}
+
+// Field of the published charges at the points, summed as
+// compute_total_normalized_e does before normalizing, and computed in
+// place in the segment. valid is false where a point is on a charge.
+// Consecutive batches of points may come from consecutive frames.
+// Returns false when the engine kept writing for FIELD_SHM_RETRIES reads.
+bool field_shm_query(field_shm_client_t *client, const vec2 *points, int num_points, vec2 *e, bool *valid)
+{
+    for (int first = 0; first < num_points;)
+    {
+        int attempt = 0, count = 0;
+        for (; attempt < FIELD_SHM_RETRIES; attempt++)
+        {
+            uint64_t sequence;
+            if (!begin_read(client, &sequence))
+                return false;
+            const field_shm_header_t *header = client->header;
+            int charge_capacity, grid_capacity;
+            if (!read_capacities(client, &charge_capacity, &grid_capacity))
+            {
+                client->retries++;
+                continue;
+            }
+            // A torn header cannot make the sum read outside of the segment
+            int n = header->num_charges;
+            n = n < 0 ? 0 : n > charge_capacity ? charge_capacity : n;
+            count = fmax(1, fmin(num_points - first, BATCH_PAIRS / fmax(n, 1)));
+            compute_total_e_batch(segment_charges(header), n, points + first, count, 1e-3, e + first, valid + first);
+            if (end_read(client, sequence))
+            {
+                client->frame = header->frame;
+                break;
+            }
+        }
+        if (attempt == FIELD_SHM_RETRIES)
+            return false;
+        first += count;
+    }
+    return true;
+}
+
+// Field at the points interpolated from the published grid, false in
+// valid outside of it, where the field is unknown, and everywhere when
+// the engine published no grid. Same return value as field_shm_query.
+bool field_shm_sample_grid(field_shm_client_t *client, const vec2 *points, int num_points, vec2 *e, bool *valid)
+{
+    for (int first = 0; first < num_points; first += FIELD_SHM_BATCH)
+    {
+        int count = fmin(FIELD_SHM_BATCH, num_points - first);
+        int attempt = 0;
+        for (; attempt < FIELD_SHM_RETRIES; attempt++)
+        {
+            uint64_t sequence;
+            if (!begin_read(client, &sequence))
+                return false;
+            const field_shm_header_t *header = client->header;
+            int charge_capacity, grid_capacity;
+            if (!read_capacities(client, &charge_capacity, &grid_capacity))
+            {
+                client->retries++;
+                continue;
+            }
+            camera_t camera = header->camera;
+            int width = header->grid_width, height = header->grid_height;
+            if (width < 0 || height < 0 || (long)width * height > grid_capacity)
+                width = height = 0;
+            const vec2 *directions = segment_directions(header, charge_capacity);
+            const float *magnitudes = segment_magnitudes(header, charge_capacity, grid_capacity);
+            for (int k = first; k < first + count; k++)
+            {
+                vec2 pixel = camera_to_pixel(&camera, points[k]);
+                double fx = pixel.x / header->grid_cell, fy = pixel.y / header->grid_cell;
+                int i = floor(fx), j = floor(fy);
+                valid[k] = false;
+                e[k] = vec2_create(0, 0);
+                if (i < 0 || j < 0 || i + 1 >= width || j + 1 >= height)
+                    continue;
+                double tx = fx - i, ty = fy - j;
+                double weights[4] = {(1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty};
+                int nodes[4] = {j * width + i, j * width + i + 1, (j + 1) * width + i, (j + 1) * width + i + 1};
+                for (int c = 0; c < 4; c++)
+                    e[k] = vec2_add(e[k], vec2_mul(weights[c] * magnitudes[nodes[c]], directions[nodes[c]]));
+                valid[k] = vec2_norm_sqr(e[k]) > 0;
+            }
+            if (end_read(client, sequence))
+            {
+                client->frame = header->frame;
+                break;
+            }
+        }
+        if (attempt == FIELD_SHM_RETRIES)
+            return false;
+    }
+    return true;
+}
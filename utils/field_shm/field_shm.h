@@ -0,0 +1,80 @@
+#ifndef _FIELD_SHM_H_
+#define _FIELD_SHM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../camera/camera.h"
+#include "../field_grid/field_grid.h"
+
+// The engine publishes the charges of every frame, and the field grid
+// when it has one, in a POSIX shared memory segment that other processes
+// sample the field from.
+// The segment is guarded by a sequence lock: the sequence is odd while the
+// engine writes, so the engine never waits for a reader, and a reader
+// that saw the sequence change while it read throws its result away and
+// reads again. Readers work on the segment in place, without copying it.
+
+#define FIELD_SHM_MAGIC 0x5a5a5046 // "FPZZ"
+#define FIELD_SHM_VERSION 1
+
+// Points a client interpolates from the grid under one read of the
+// sequence, a torn read only costs the batch it happened in
+#define FIELD_SHM_BATCH 256
+
+// Reads of a batch given up on while the engine keeps writing
+#define FIELD_SHM_RETRIES 64
+
+// Start of the segment, followed by charge_capacity charges then by
+// grid_capacity directions and as many magnitudes
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;       // Odd while the engine writes
+    uint64_t frame;          // Publications so far
+    int32_t charge_capacity;
+    int32_t grid_capacity;
+    int32_t num_charges;
+    int32_t grid_width;      // 0 without a grid
+    int32_t grid_height;
+    double grid_cell;
+    camera_t camera;         // Maps the world to the pixels of the grid
+} field_shm_header_t;
+
+// Engine side
+typedef struct
+{
+    char name[64];
+    int fd;
+    field_shm_header_t *header;
+    size_t size;
+} field_shm_t;
+
+// Client side
+typedef struct
+{
+    int fd;
+    const field_shm_header_t *header;
+    size_t size;
+    uint64_t frame; // Frame of the last batch read
+    int retries;    // Batches read again because the engine wrote meanwhile, so far
+} field_shm_client_t;
+
+field_shm_t *field_shm_create(const char *name);
+
+void field_shm_destroy(field_shm_t *shm);
+
+bool field_shm_publish(field_shm_t *shm, const charge_t *charges, int num_charges, const camera_t *camera, const field_grid_t *grid);
+
+field_shm_client_t *field_shm_open(const char *name);
+
+void field_shm_close(field_shm_client_t *client);
+
+bool field_shm_query(field_shm_client_t *client, const vec2 *points, int num_points, vec2 *e, bool *valid);
+
+bool field_shm_sample_grid(field_shm_client_t *client, const vec2 *points, int num_points, vec2 *e, bool *valid);
+
+#endif
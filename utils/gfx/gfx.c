@@ -7,6 +7,8 @@
 #include "gfx.h"
 #include <assert.h>
 #include "../vec2/vec2.h"
+#include "../memory/memory.h"
+#include "raster.h"
 
 /// Create a fullscreen graphic window.
 /// @param title Title of the window.
@@ -22,8 +24,8 @@ struct gfx_context_t *gfx_create(char *title, uint32_t width, uint32_t height)
     SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
     SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
                                              SDL_TEXTUREACCESS_STREAMING, width, height);
-    uint32_t *pixels = malloc(width * height * sizeof(uint32_t));
-    struct gfx_context_t *ctxt = malloc(sizeof(struct gfx_context_t));
+    uint32_t *pixels = mem_alloc(width * height * sizeof(uint32_t));
+    struct gfx_context_t *ctxt = mem_alloc(sizeof(struct gfx_context_t));
 
     if (!window || !renderer || !texture || !pixels || !ctxt)
         goto error;
@@ -61,9 +63,7 @@ void gfx_putpixel(struct gfx_context_t *ctxt, uint32_t column, uint32_t row, uin
 /// @param color Color to use.
 void gfx_clear(struct gfx_context_t *ctxt, uint32_t color)
 {
-    int n = ctxt->width * ctxt->height;
-    while (n)
-        ctxt->pixels[--n] = color;
+    raster_fill(ctxt->pixels, (size_t)ctxt->width * ctxt->height, color);
 }
 
 /// Display the graphic context.
@@ -76,6 +76,14 @@ void gfx_present(struct gfx_context_t *ctxt)
     SDL_RenderPresent(ctxt->renderer);
 }
 
+/// Change the title of the window, used to show statistics.
+/// @param ctxt Graphic context of the window.
+/// @param title New title.
+void gfx_set_title(struct gfx_context_t *ctxt, const char *title)
+{
+    SDL_SetWindowTitle(ctxt->window, title);
+}
+
 /// Destroy a graphic window.
 /// @param ctxt Graphic context of the window to close.
 void gfx_destroy(struct gfx_context_t *ctxt)
@@ -84,16 +92,18 @@ void gfx_destroy(struct gfx_context_t *ctxt)
     SDL_DestroyTexture(ctxt->texture);
     SDL_DestroyRenderer(ctxt->renderer);
     SDL_DestroyWindow(ctxt->window);
-    free(ctxt->pixels);
+    mem_free(ctxt->pixels);
     ctxt->texture = NULL;
     ctxt->renderer = NULL;
     ctxt->window = NULL;
     ctxt->pixels = NULL;
     SDL_Quit();
-    free(ctxt);
+    mem_free(ctxt);
 }
 
 /// If a key was pressed, returns its key code (non blocking call).
+/// A mouse click returns SDL_MOUSEBUTTONDOWN, and the mouse wheel returns
+/// GFX_WHEEL_UP or GFX_WHEEL_DOWN, both with the mouse position in x and y.
 /// List of key codes: https://wiki.libsdl.org/SDL_Keycode
 /// @return the key that was pressed or 0 if none was pressed.
 SDL_Keycode gfx_keypressed(int *x, int *y)
@@ -105,6 +115,11 @@ SDL_Keycode gfx_keypressed(int *x, int *y)
         {
             return event.key.keysym.sym;
         }
+        if (event.type == SDL_MOUSEWHEEL && event.wheel.y != 0)
+        {
+            SDL_GetMouseState(x, y);
+            return event.wheel.y > 0 ? GFX_WHEEL_UP : GFX_WHEEL_DOWN;
+        }
         if (event.type == SDL_MOUSEBUTTONDOWN)
         {
             *x = event.button.x;
@@ -177,15 +192,16 @@ void draw_full_circle(struct gfx_context_t *ctxt, uint32_t c_column, uint32_t c_
         draw_full_circle(ctxt, c_column, c_row, r - 1, color);
 }
 
-void draw_rectangle(struct gfx_context_t *ctxt, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t color)
+/// Draw a filled rectangle, clipped to the context.
+/// @param ctxt Graphic context to draw in.
+/// @param x X coordinate of the top left corner.
+/// @param y Y coordinate of the top left corner.
+/// @param width Width of the rectangle in pixels.
+/// @param height Height of the rectangle in pixels.
+/// @param color Color to use.
+void draw_rectangle(struct gfx_context_t *ctxt, int x, int y, int width, int height, uint32_t color)
 {
-    for (uint32_t i = 0; i < width; i++)
-    {
-        for (uint32_t j = 0; j < height; j++)
-        {
-            gfx_putpixel(ctxt, x + i, y + j, color);
-        }
-    }
+    raster_fill_rect(ctxt->pixels, ctxt->width, ctxt->height, x, y, width, height, color);
 }
 
 // Those are illegal to use in the final product
@@ -19,6 +19,11 @@
 #define COLOR_WHITE 0x00FFFFFF
 #define COLOR_YELLOW 0x00FFFF00
 
+// Codes of the mouse wheel returned by gfx_keypressed, apart from the
+// keys so that the keyboard and the wheel can be told apart
+#define GFX_WHEEL_UP (SDL_MOUSEWHEEL + 1)
+#define GFX_WHEEL_DOWN (SDL_MOUSEWHEEL + 2)
+
 struct gfx_context_t
 {
     SDL_Window *window;
@@ -41,6 +46,7 @@ extern void gfx_clear(struct gfx_context_t *ctxt, uint32_t color);
 extern struct gfx_context_t *gfx_create(char *text, uint32_t width, uint32_t height);
 extern void gfx_destroy(struct gfx_context_t *ctxt);
 extern void gfx_present(struct gfx_context_t *ctxt);
+extern void gfx_set_title(struct gfx_context_t *ctxt, const char *title);
 // new
 void gfx_draw_line(struct gfx_context_t *ctxt, coordinates_t p0, coordinates_t p1, uint32_t color);
 void gfx_draw_circle(struct gfx_context_t *ctxt, coordinates_t c, uint32_t r, uint32_t color);
@@ -49,6 +55,7 @@ extern SDL_Keycode gfx_keypressed(int *x, int *y);
 extern void draw_circle(struct gfx_context_t *ctxt, uint32_t c_column, uint32_t c_row, uint32_t r, uint32_t color);
 extern void draw_line(struct gfx_context_t *ctxt, int x0, int y0, int x1, int y1, uint32_t color);
 extern void draw_full_circle(struct gfx_context_t *ctxt, uint32_t c_column, uint32_t c_row, uint32_t r, uint32_t color);
+void draw_rectangle(struct gfx_context_t *ctxt, int x, int y, int width, int height, uint32_t color);
 
 bool gfx_mouseclicked(int *x, int *y);
 
@@ -0,0 +1,204 @@
+#include <string.h>
+#include "raster.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RASTER_X86 1
+#endif
+
+// Spans longer than this are split between the threads
+#define PARALLEL_SPAN (1 << 16)
+
+// Fills longer than this bypass the cache, they would only evict what the
+// next draws need
+#define STREAMING_SPAN (1 << 12)
+
+typedef struct
+{
+    void (*fill)(uint32_t *dst, size_t n, uint32_t color);
+    void (*blend)(uint32_t *dst, size_t n, uint32_t color, uint8_t alpha);
+    void (*composite)(uint32_t *dst, const uint32_t *src, size_t n);
+} raster_kernels_t;
+
+// a * s + (255 - a) * d over 255, rounded, for each byte
+static inline uint32_t mix_channel(uint32_t s, uint32_t d, uint32_t a)
+{
+    uint32_t t = s * a + d * (255 - a) + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t mix_pixel(uint32_t s, uint32_t d, uint32_t a)
+{
+    return mix_channel(s & 0xff, d & 0xff, a) |
+           mix_channel(s >> 8 & 0xff, d >> 8 & 0xff, a) << 8 |
+           mix_channel(s >> 16 & 0xff, d >> 16 & 0xff, a) << 16 |
+           mix_channel(s >> 24, d >> 24, a) << 24;
+}
+
+static void fill_scalar(uint32_t *dst, size_t n, uint32_t color)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = color;
+}
+
+static void blend_scalar(uint32_t *dst, size_t n, uint32_t color, uint8_t alpha)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = mix_pixel(color, dst[i], alpha);
+}
+
+// The source is drawn over with its own alpha
+static void composite_scalar(uint32_t *dst, const uint32_t *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = mix_pixel(src[i], dst[i], src[i] >> 24);
+}
+
+static const raster_kernels_t scalar_kernels = {fill_scalar, blend_scalar, composite_scalar};
+
+#ifdef RASTER_X86
+
+// mix_channel on 16 bit lanes
+__attribute__((target("avx2"))) static inline __m256i mix_avx2(__m256i s, __m256i d, __m256i a)
+{
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(s, a),
+                                 _mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a)));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2"))) static void fill_avx2(uint32_t *dst, size_t n, uint32_t color)
+{
+    __m256i c = _mm256_set1_epi32(color);
+    size_t i = 0;
+    if (n < STREAMING_SPAN)
+    {
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i *)(dst + i), c);
+        fill_scalar(dst + i, n - i, color);
+        return;
+    }
+    for (; i < n && ((uintptr_t)(dst + i) & 31); i++)
+        dst[i] = color;
+    // Streaming stores do not read the lines they overwrite
+    for (; i + 8 <= n; i += 8)
+        _mm256_stream_si256((__m256i *)(dst + i), c);
+    _mm_sfence();
+    for (; i < n; i++)
+        dst[i] = color;
+}
+
+__attribute__((target("avx2"))) static void blend_avx2(uint32_t *dst, size_t n, uint32_t color, uint8_t alpha)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i s = _mm256_unpacklo_epi8(_mm256_set1_epi32(color), zero);
+    __m256i a = _mm256_set1_epi16(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i d = _mm256_loadu_si256((__m256i *)(dst + i));
+        __m256i lo = mix_avx2(s, _mm256_unpacklo_epi8(d, zero), a);
+        __m256i hi = mix_avx2(s, _mm256_unpackhi_epi8(d, zero), a);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    blend_scalar(dst + i, n - i, color, alpha);
+}
+
+__attribute__((target("avx2"))) static void composite_avx2(uint32_t *dst, const uint32_t *src, size_t n)
+{
+    __m256i zero = _mm256_setzero_si256();
+    // Copies the alpha byte of each pixel to the 16 bit lanes of its four channels
+    __m256i spread = _mm256_setr_epi8(6, -1, 6, -1, 6, -1, 6, -1, 14, -1, 14, -1, 14, -1, 14, -1,
+                                      6, -1, 6, -1, 6, -1, 6, -1, 14, -1, 14, -1, 14, -1, 14, -1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + i));
+        __m256i d = _mm256_loadu_si256((__m256i *)(dst + i));
+        __m256i s_lo = _mm256_unpacklo_epi8(s, zero), s_hi = _mm256_unpackhi_epi8(s, zero);
+        __m256i lo = mix_avx2(s_lo, _mm256_unpacklo_epi8(d, zero), _mm256_shuffle_epi8(s_lo, spread));
+        __m256i hi = mix_avx2(s_hi, _mm256_unpackhi_epi8(d, zero), _mm256_shuffle_epi8(s_hi, spread));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    composite_scalar(dst + i, src + i, n - i);
+}
+
+static const raster_kernels_t avx2_kernels = {fill_avx2, blend_avx2, composite_avx2};
+
+#endif
+
+static const raster_kernels_t *kernels = NULL;
+
+// Choose the AVX2 path when the CPU has it and enabled is true.
+// Returns true if the AVX2 path is in use.
+bool raster_use_simd(bool enabled)
+{
+    kernels = &scalar_kernels;
+#ifdef RASTER_X86
+    if (enabled && __builtin_cpu_supports("avx2"))
+        kernels = &avx2_kernels;
+    return kernels == &avx2_kernels;
+#else
+    (void)enabled;
+    return false;
+#endif
+}
+
+static const raster_kernels_t *get_kernels(void)
+{
+    if (!kernels)
+        raster_use_simd(true);
+    return kernels;
+}
+
+void raster_fill(uint32_t *dst, size_t n, uint32_t color)
+{
+    const raster_kernels_t *k = get_kernels();
+    if (n < PARALLEL_SPAN)
+    {
+        k->fill(dst, n, color);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (size_t start = 0; start < n; start += PARALLEL_SPAN)
+        k->fill(dst + start, n - start < PARALLEL_SPAN ? n - start : PARALLEL_SPAN, color);
+}
+
+// Clipped to the width x height pixels
+void raster_fill_rect(uint32_t *pixels, uint32_t width, uint32_t height, int x, int y, int w, int h, uint32_t color)
+{
+    int x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+    int x1 = x + w > (int)width ? (int)width : x + w;
+    int y1 = y + h > (int)height ? (int)height : y + h;
+    if (x1 <= x0 || y1 <= y0)
+        return;
+    const raster_kernels_t *k = get_kernels();
+    for (int row = y0; row < y1; row++)
+        k->fill(pixels + (size_t)row * width + x0, x1 - x0, color);
+}
+
+void raster_blend(uint32_t *dst, size_t n, uint32_t color, uint8_t alpha)
+{
+    const raster_kernels_t *k = get_kernels();
+    if (n < PARALLEL_SPAN)
+    {
+        k->blend(dst, n, color, alpha);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (size_t start = 0; start < n; start += PARALLEL_SPAN)
+        k->blend(dst + start, n - start < PARALLEL_SPAN ? n - start : PARALLEL_SPAN, color, alpha);
+}
+
+void raster_composite(uint32_t *dst, const uint32_t *src, size_t n)
+{
+    const raster_kernels_t *k = get_kernels();
+    if (n < PARALLEL_SPAN)
+    {
+        k->composite(dst, src, n);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (size_t start = 0; start < n; start += PARALLEL_SPAN)
+        k->composite(dst + start, src + start, n - start < PARALLEL_SPAN ? n - start : PARALLEL_SPAN);
+}
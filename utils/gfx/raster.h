@@ -0,0 +1,22 @@
+#ifndef _RASTER_H_
+#define _RASTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Raster primitives on spans of 0xAARRGGBB pixels, with an AVX2 path
+// chosen at run time on x86 and a scalar one everywhere else.
+// Both paths give the same pixels.
+
+void raster_fill(uint32_t *dst, size_t n, uint32_t color);
+
+void raster_fill_rect(uint32_t *pixels, uint32_t width, uint32_t height, int x, int y, int w, int h, uint32_t color);
+
+void raster_blend(uint32_t *dst, size_t n, uint32_t color, uint8_t alpha);
+
+void raster_composite(uint32_t *dst, const uint32_t *src, size_t n);
+
+bool raster_use_simd(bool enabled);
+
+#endif
@@ -0,0 +1,203 @@
+#include "raster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+typedef struct _test_result
+{
+    bool passed;
+    const char *name;
+} test_result;
+
+typedef test_result (*unit_test_t)(void);
+
+void print_in_color(char *color, char *text)
+{
+    printf("\033%s", color);
+    printf("%s", text);
+    printf("\033[0m");
+}
+void print_in_red(char *text)
+{
+    print_in_color("[0;31m", text);
+}
+void print_in_green(char *text)
+{
+    print_in_color("[0;32m", text);
+}
+
+#define SPAN 1000
+
+// Past the streaming stores of fills (1 << 12) and the split between the
+// threads (1 << 16) of raster.c, with ragged ends around both
+static const size_t large_spans[] = {(1 << 12) - 1, (1 << 12) + 13, (1 << 16) - 3, (1 << 16) + 5, 3 * (1 << 16) + 1};
+#define LARGE_SPAN (3 * (1 << 16) + 1)
+#define NUM_LARGE_SPANS (sizeof(large_spans) / sizeof(large_spans[0]))
+// Room before and after a span, which must stay untouched
+#define GUARD 16
+
+static void random_pixels(uint32_t *pixels, int n, unsigned seed)
+{
+    srand(seed);
+    for (int i = 0; i < n; i++)
+        pixels[i] = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+test_result t_raster_fill_0()
+{
+    uint32_t pixels[SPAN + 2];
+    bool passed = true;
+    // Every length and alignment around the vector width
+    for (int offset = 0; offset < 2; offset++)
+        for (int n = 0; n < 40; n++)
+        {
+            memset(pixels, 0, sizeof(pixels));
+            raster_fill(pixels + offset, n, 0x00123456);
+            for (int i = 0; i < SPAN + 2; i++)
+                if (pixels[i] != (i >= offset && i < offset + n ? 0x00123456u : 0))
+                    passed = false;
+        }
+    return (test_result){.passed = passed,
+                         .name = "Test raster_fill 0"};
+}
+test_result t_raster_fill_rect_0()
+{
+    uint32_t pixels[10 * 10] = {0};
+    raster_fill_rect(pixels, 10, 10, -2, 7, 5, 10, 1);
+    bool passed = true;
+    for (int row = 0; row < 10; row++)
+        for (int column = 0; column < 10; column++)
+            if (pixels[row * 10 + column] != (row >= 7 && column < 3 ? 1u : 0))
+                passed = false;
+    return (test_result){.passed = passed,
+                         .name = "Test raster_fill_rect 0"};
+}
+test_result t_raster_blend_0()
+{
+    uint32_t pixels[SPAN], expected[SPAN];
+    random_pixels(pixels, SPAN, 1);
+    memcpy(expected, pixels, sizeof(pixels));
+    bool passed = true;
+    // Opaque and transparent blends are exact
+    raster_blend(pixels, SPAN, 0x00abcdef, 0);
+    passed = passed && memcmp(pixels, expected, sizeof(pixels)) == 0;
+    raster_blend(pixels, SPAN, 0x00abcdef, 255);
+    for (int i = 0; i < SPAN; i++)
+        passed = passed && pixels[i] == 0x00abcdef;
+    return (test_result){.passed = passed,
+                         .name = "Test raster_blend 0"};
+}
+test_result t_raster_simd_0()
+{
+    // The vector path gives the same pixels as the scalar one
+    uint32_t src[SPAN], scalar[SPAN], simd[SPAN];
+    random_pixels(src, SPAN, 2);
+    random_pixels(scalar, SPAN, 3);
+    memcpy(simd, scalar, sizeof(scalar));
+
+    raster_use_simd(false);
+    raster_blend(scalar, SPAN - 3, 0x80402010, 77);
+    raster_composite(scalar, src, SPAN - 5);
+    raster_use_simd(true);
+    raster_blend(simd, SPAN - 3, 0x80402010, 77);
+    raster_composite(simd, src, SPAN - 5);
+
+    return (test_result){.passed = memcmp(scalar, simd, sizeof(simd)) == 0,
+                         .name = "Test raster_simd 0"};
+}
+test_result t_raster_fill_1()
+{
+    // Large spans starting at every alignment of a 32 byte vector
+    uint32_t *pixels = malloc((LARGE_SPAN + 2 * GUARD) * sizeof(uint32_t));
+    bool passed = pixels != NULL;
+    for (size_t s = 0; passed && s < NUM_LARGE_SPANS; s++)
+        for (size_t offset = 0; offset < 8; offset++)
+        {
+            memset(pixels, 0, (LARGE_SPAN + 2 * GUARD) * sizeof(uint32_t));
+            raster_fill(pixels + GUARD + offset, large_spans[s], 0x00123456);
+            for (size_t i = 0; i < LARGE_SPAN + 2 * GUARD; i++)
+                if (pixels[i] != (i >= GUARD + offset && i < GUARD + offset + large_spans[s] ? 0x00123456u : 0))
+                    passed = false;
+        }
+    free(pixels);
+    return (test_result){.passed = passed,
+                         .name = "Test raster_fill 1"};
+}
+test_result t_raster_simd_1()
+{
+    // Large spans, unaligned, give the same pixels as the scalar path
+    size_t size = LARGE_SPAN + 2 * GUARD;
+    uint32_t *src = malloc(size * sizeof(uint32_t));
+    uint32_t *initial = malloc(size * sizeof(uint32_t));
+    uint32_t *scalar = malloc(size * sizeof(uint32_t));
+    uint32_t *simd = malloc(size * sizeof(uint32_t));
+    bool passed = src && initial && scalar && simd;
+    if (passed)
+    {
+        random_pixels(src, size, 4);
+        random_pixels(initial, size, 5);
+    }
+    for (size_t s = 0; passed && s < NUM_LARGE_SPANS; s++)
+        for (int offset = 1; offset < 8; offset += 3)
+        {
+            size_t n = large_spans[s];
+            memcpy(scalar, initial, size * sizeof(uint32_t));
+            memcpy(simd, initial, size * sizeof(uint32_t));
+
+            raster_use_simd(false);
+            raster_fill(scalar + GUARD + offset, n / 2, 0x00fedcba);
+            raster_blend(scalar + GUARD + offset, n, 0x80402010, 77);
+            raster_composite(scalar + GUARD + offset, src + offset, n);
+            raster_use_simd(true);
+            raster_fill(simd + GUARD + offset, n / 2, 0x00fedcba);
+            raster_blend(simd + GUARD + offset, n, 0x80402010, 77);
+            raster_composite(simd + GUARD + offset, src + offset, n);
+
+            passed = passed && memcmp(scalar, simd, size * sizeof(uint32_t)) == 0;
+        }
+    raster_use_simd(true);
+    free(src);
+    free(initial);
+    free(scalar);
+    free(simd);
+    return (test_result){.passed = passed,
+                         .name = "Test raster_simd 1"};
+}
+//Add or remove your test function name here
+const unit_test_t tests[] = {
+    t_raster_fill_0,
+    t_raster_fill_1,
+    t_raster_fill_rect_0,
+    t_raster_blend_0,
+    t_raster_simd_0,
+    t_raster_simd_1};
+
+int main()
+{
+    uint32_t nb_tests = sizeof(tests) / sizeof(unit_test_t);
+    char message[256];
+    bool all_passed = true;
+
+    for (uint32_t i = 0; i < nb_tests; i++)
+    {
+        printf("Running test n°%d: ...\n", i);
+        test_result r = tests[i]();
+        if (r.passed)
+        {
+            sprintf(message, "\t- %s : OK", r.name);
+            print_in_green(message);
+        }
+        else
+        {
+            all_passed = false;
+            sprintf(message, "\t- %s : FAILED", r.name);
+            print_in_red(message);
+        }
+        printf("\n");
+    }
+    if (all_passed)
+        print_in_green("\nTests suite result : OK\n");
+    else
+        print_in_red("\nTests suite result : FAILED\n");
+}
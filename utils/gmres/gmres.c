@@ -0,0 +1,117 @@
+#include <math.h>
+#include <string.h>
+#include "gmres.h"
+
+gmres_t gmres_create(int restart, int max_iterations, double tolerance)
+{
+    gmres_t solver = {.restart = restart, .max_iterations = max_iterations, .tolerance = tolerance};
+    return solver;
+}
+
+static double dot(const double *a, const double *b, int n)
+{
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// Restarted GMRES with modified Gram-Schmidt and Givens rotations.
+// x holds the initial guess, and the solution on return.
+// Returns true if the tolerance was reached.
+bool gmres_solve(gmres_t *solver, arena_t *arena, matvec_t matvec, void *user, const double *b, double *x, int n)
+{
+    int m = solver->restart;
+    double *v = arena_alloc(arena, (size_t)(m + 1) * n * sizeof(double));
+    double *h = arena_calloc(arena, (size_t)(m + 1) * m, sizeof(double));
+    double *cs = arena_alloc(arena, m * sizeof(double));
+    double *sn = arena_alloc(arena, m * sizeof(double));
+    double *g = arena_alloc(arena, (m + 1) * sizeof(double));
+    double *w = arena_alloc(arena, n * sizeof(double));
+
+    double b_norm = sqrt(dot(b, b, n));
+    if (b_norm == 0)
+        b_norm = 1;
+
+    solver->iterations = 0;
+    solver->residual = INFINITY;
+    while (solver->iterations < solver->max_iterations)
+    {
+        // r = b - A x becomes the first Krylov vector
+        matvec(user, x, w, n);
+        for (int i = 0; i < n; i++)
+            v[i] = b[i] - w[i];
+        double beta = sqrt(dot(v, v, n));
+        solver->residual = beta / b_norm;
+        if (solver->residual <= solver->tolerance)
+            return true;
+        for (int i = 0; i < n; i++)
+            v[i] /= beta;
+        memset(g, 0, (m + 1) * sizeof(double));
+        g[0] = beta;
+
+        int k = 0;
+        for (; k < m && solver->iterations < solver->max_iterations; k++, solver->iterations++)
+        {
+            double *vk = v + (size_t)k * n;
+            double *vn = v + (size_t)(k + 1) * n;
+            matvec(user, vk, vn, n);
+            for (int j = 0; j <= k; j++)
+            {
+                double *vj = v + (size_t)j * n;
+                double hjk = dot(vn, vj, n);
+                h[j * m + k] = hjk;
+                for (int i = 0; i < n; i++)
+                    vn[i] -= hjk * vj[i];
+            }
+            double norm = sqrt(dot(vn, vn, n));
+            h[(k + 1) * m + k] = norm;
+            if (norm > 0)
+                for (int i = 0; i < n; i++)
+                    vn[i] /= norm;
+
+            // Keep H upper triangular with the rotations of the previous columns
+            for (int j = 0; j < k; j++)
+            {
+                double a = h[j * m + k], c = h[(j + 1) * m + k];
+                h[j * m + k] = cs[j] * a + sn[j] * c;
+                h[(j + 1) * m + k] = -sn[j] * a + cs[j] * c;
+            }
+            double a = h[k * m + k], c = h[(k + 1) * m + k];
+            double r = hypot(a, c);
+            cs[k] = r > 0 ? a / r : 1;
+            sn[k] = r > 0 ? c / r : 0;
+            h[k * m + k] = r;
+            h[(k + 1) * m + k] = 0;
+            g[k + 1] = -sn[k] * g[k];
+            g[k] = cs[k] * g[k];
+
+            solver->residual = fabs(g[k + 1]) / b_norm;
+            if (solver->residual <= solver->tolerance || norm == 0)
+            {
+                k++;
+                solver->iterations++;
+                break;
+            }
+        }
+
+        // Solve the triangular system and update x
+        for (int j = k - 1; j >= 0; j--)
+        {
+            double sum = g[j];
+            for (int l = j + 1; l < k; l++)
+                sum -= h[j * m + l] * g[l];
+            g[j] = sum / h[j * m + j];
+        }
+        for (int j = 0; j < k; j++)
+        {
+            double *vj = v + (size_t)j * n;
+            for (int i = 0; i < n; i++)
+                x[i] += g[j] * vj[i];
+        }
+
+        if (solver->residual <= solver->tolerance)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,23 @@
+#ifndef _GMRES_H_
+#define _GMRES_H_
+
+#include <stdbool.h>
+#include "../memory/memory.h"
+
+// y = A x for a system of size n, the matrix is never formed
+typedef void (*matvec_t)(void *user, const double *x, double *y, int n);
+
+typedef struct
+{
+    int restart;        // Krylov vectors kept before restarting
+    int max_iterations;
+    double tolerance;   // On the residual relative to the right-hand side
+    int iterations;     // Iterations done by the last solve
+    double residual;    // Relative residual reached by the last solve
+} gmres_t;
+
+gmres_t gmres_create(int restart, int max_iterations, double tolerance);
+
+bool gmres_solve(gmres_t *solver, arena_t *arena, matvec_t matvec, void *user, const double *b, double *x, int n);
+
+#endif
@@ -0,0 +1,141 @@
+#include <math.h>
+#include "interaction.h"
+
+// r^2 is never taken below this, so that close pairs don't blow up
+#define MIN_DISTANCE_SQ 1e-3
+
+const char *force_law_names[LAW_COUNT] = {"Coulomb", "Plummer", "cutoff", "Yukawa"};
+
+// Every length of the laws set to the same value, e.g. a few pixels
+interaction_t interaction_create(force_law_t law, double length)
+{
+    interaction_t interaction = {.law = law, .softening = length, .cutoff = length, .screening = length};
+    return interaction;
+}
+
+// Each law gives, for a pair at squared distance r2 with charges product
+// qq, the factor s of the force s * (pi - pj) on i, and its energy.
+// r2 is never 0, the pairs i == j are skipped by the loops.
+
+static inline double coulomb_force(double r2, double qq, const interaction_t *p)
+{
+    (void)p;
+    return K * qq / (sqrt(r2) * fmax(r2, MIN_DISTANCE_SQ));
+}
+
+static inline double coulomb_energy(double r2, double qq, const interaction_t *p)
+{
+    (void)p;
+    return K * qq / sqrt(fmax(r2, MIN_DISTANCE_SQ));
+}
+
+static inline double plummer_force(double r2, double qq, const interaction_t *p)
+{
+    double soft = r2 + p->softening * p->softening;
+    return K * qq / (soft * sqrt(soft));
+}
+
+static inline double plummer_energy(double r2, double qq, const interaction_t *p)
+{
+    return K * qq / sqrt(r2 + p->softening * p->softening);
+}
+
+// The mask multiplies rather than branches, the energy is shifted to be
+// continuous at the cutoff
+static inline double cutoff_force(double r2, double qq, const interaction_t *p)
+{
+    return (r2 < p->cutoff * p->cutoff) * coulomb_force(r2, qq, p);
+}
+
+static inline double cutoff_energy(double r2, double qq, const interaction_t *p)
+{
+    return (r2 < p->cutoff * p->cutoff) * (coulomb_energy(r2, qq, p) - K * qq / p->cutoff);
+}
+
+static inline double yukawa_force(double r2, double qq, const interaction_t *p)
+{
+    double r = sqrt(r2), x = r / p->screening;
+    return K * qq * exp(-x) * (1 + x) / (r * fmax(r2, MIN_DISTANCE_SQ));
+}
+
+static inline double yukawa_energy(double r2, double qq, const interaction_t *p)
+{
+    return coulomb_energy(r2, qq, p) * exp(-sqrt(r2) / p->screening);
+}
+
+// The pair loop of a law, with or without the energy. The charges are
+// read from arrays so that the loop over j vectorizes, and j runs on both
+// sides of i rather than testing i == j. Every force is summed over j in
+// the same order whatever the number of threads.
+#define DEFINE_KERNEL(law, with_energy)                                                          \
+    static void law##_kernel_##with_energy(const double *x, const double *y, const double *q,   \
+                                           int n, const interaction_t *p, vec2 *forces,         \
+                                           double *energies)                                    \
+    {                                                                                            \
+        _Pragma("omp parallel for schedule(static)") for (int i = 0; i < n; i++)                 \
+        {                                                                                        \
+            double fx = 0, fy = 0, u = 0;                                                        \
+            for (int side = 0; side < 2; side++)                                                 \
+            {                                                                                    \
+                int j0 = side ? i + 1 : 0, j1 = side ? n : i;                                    \
+                _Pragma("omp simd reduction(+ : fx, fy, u)") for (int j = j0; j < j1; j++)       \
+                {                                                                                \
+                    double dx = x[i] - x[j], dy = y[i] - y[j];                                   \
+                    double r2 = dx * dx + dy * dy, qq = q[i] * q[j];                             \
+                    double s = law##_force(r2, qq, p);                                           \
+                    fx += s * dx;                                                                \
+                    fy += s * dy;                                                                \
+                    if (with_energy)                                                             \
+                        u += law##_energy(r2, qq, p);                                            \
+                }                                                                                \
+            }                                                                                    \
+            forces[i] = vec2_create(fx, fy);                                                     \
+            if (with_energy)                                                                     \
+                energies[i] = u;                                                                 \
+        }                                                                                        \
+    }
+
+DEFINE_KERNEL(coulomb, 0)
+DEFINE_KERNEL(coulomb, 1)
+DEFINE_KERNEL(plummer, 0)
+DEFINE_KERNEL(plummer, 1)
+DEFINE_KERNEL(cutoff, 0)
+DEFINE_KERNEL(cutoff, 1)
+DEFINE_KERNEL(yukawa, 0)
+DEFINE_KERNEL(yukawa, 1)
+
+typedef void (*kernel_t)(const double *x, const double *y, const double *q, int n, const interaction_t *p, vec2 *forces, double *energies);
+
+// Indexed by the law, then by whether the energy is wanted
+static const kernel_t kernels[LAW_COUNT][2] = {
+    [LAW_COULOMB] = {coulomb_kernel_0, coulomb_kernel_1},
+    [LAW_PLUMMER] = {plummer_kernel_0, plummer_kernel_1},
+    [LAW_CUTOFF] = {cutoff_kernel_0, cutoff_kernel_1},
+    [LAW_YUKAWA] = {yukawa_kernel_0, yukawa_kernel_1},
+};
+
+// Pairwise forces of the law, and the potential energy when energy is not
+// NULL. Has the signature of a force solver, interaction is an interaction_t.
+void interaction_forces(void *interaction, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy)
+{
+    const interaction_t *p = interaction;
+    double *x = arena_alloc(arena, num_charges * sizeof(double));
+    double *y = arena_alloc(arena, num_charges * sizeof(double));
+    double *q = arena_alloc(arena, num_charges * sizeof(double));
+    double *energies = energy ? arena_alloc(arena, num_charges * sizeof(double)) : NULL;
+    for (int i = 0; i < num_charges; i++)
+    {
+        x[i] = charges[i].pos.x;
+        y[i] = charges[i].pos.y;
+        q[i] = charges[i].q;
+    }
+
+    kernels[p->law][energy != NULL](x, y, q, num_charges, p, forces, energies);
+
+    if (energy)
+    {
+        *energy = 0;
+        for (int i = 0; i < num_charges; i++)
+            *energy += 0.5 * energies[i];
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef _INTERACTION_H_
+#define _INTERACTION_H_
+
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../memory/memory.h"
+
+// Force between two charges. Each law has its own pair loop, stamped out
+// at compile time without branches, and picked once per call.
+typedef enum
+{
+    LAW_COULOMB, // K qi qj / r^2, r^2 clamped to 1e-3 as update_charges always did
+    LAW_PLUMMER, // Softened, K qi qj r / (r^2 + softening^2)^(3/2)
+    LAW_CUTOFF,  // Coulomb up to cutoff, nothing past it
+    LAW_YUKAWA,  // Screened, K qi qj exp(-r / screening) (1 + r / screening) / r^2
+    LAW_COUNT
+} force_law_t;
+
+extern const char *force_law_names[LAW_COUNT];
+
+typedef struct
+{
+    force_law_t law;
+    double softening; // Plummer length
+    double cutoff;    // Range of the cut off law
+    double screening; // Yukawa length
+} interaction_t;
+
+interaction_t interaction_create(force_law_t law, double length);
+
+void interaction_forces(void *interaction, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy);
+
+#endif
@@ -0,0 +1,164 @@
+#include <math.h>
+#include <string.h>
+#include "lic.h"
+#include "../memory/memory.h"
+#include "../rng/rng.h"
+
+// Contrast stretch of the convolved noise, whose spread shrinks with the filter
+#define CONTRAST 6
+
+void lic_init(lic_t *lic, int width, int height, uint64_t seed)
+{
+    lic->width = width;
+    lic->height = height;
+    lic->kernel_length = 15;
+    lic->streamline_length = 60;
+    lic->noise = mem_alloc((size_t)width * height * sizeof(float));
+    lic->sum = mem_alloc((size_t)width * height * sizeof(float));
+    lic->hits = mem_alloc((size_t)width * height * sizeof(int));
+    for (int row = 0; row < height; row++)
+    {
+        rng_t rng = rng_create(seed, RNG_STREAM_LIC, row);
+        for (int column = 0; column < width; column++)
+            lic->noise[row * width + column] = rng_uniform(&rng);
+    }
+}
+
+void lic_free(lic_t *lic)
+{
+    mem_free(lic->noise);
+    mem_free(lic->sum);
+    mem_free(lic->hits);
+}
+
+typedef struct
+{
+    int x0, y0, x1, y1;
+} tile_t;
+
+static bool in_tile(tile_t *tile, vec2 p)
+{
+    return p.x >= tile->x0 && p.x < tile->x1 && p.y >= tile->y0 && p.y < tile->y1;
+}
+
+// Midpoint steps of one pixel along (sign 1) or against (sign -1) the field.
+// Points more than `margin` steps out of the tile can't be deposited, the
+// tracing stops there. Returns the number of points stored.
+static int trace(field_grid_t *grid, tile_t *tile, int margin, vec2 seed, int sign, int max_points, vec2 *points)
+{
+    vec2 p = seed;
+    int n = 0, outside = 0;
+    while (n < max_points && outside <= margin)
+    {
+        vec2 d, mid;
+        if (!field_grid_direction(grid, p, &d))
+            break;
+        if (!field_grid_direction(grid, vec2_create(p.x + 0.5 * sign * d.x, p.y + 0.5 * sign * d.y), &mid))
+            break;
+        p.x += sign * mid.x;
+        p.y += sign * mid.y;
+        points[n++] = p;
+        outside = in_tile(tile, p) ? 0 : outside + 1;
+    }
+    return n;
+}
+
+static float noise_at(lic_t *lic, vec2 p)
+{
+    int column = p.x, row = p.y;
+    if (column < 0 || row < 0 || column >= lic->width || row >= lic->height)
+        return 0.5;
+    return lic->noise[row * lic->width + column];
+}
+
+// FastLIC over one tile: a streamline is traced from every pixel no
+// streamline went through yet, and the running box filter along it is
+// deposited in all the pixels of the tile it crosses
+static void render_tile(lic_t *lic, field_grid_t *grid, tile_t *tile)
+{
+    int half = lic->streamline_length + lic->kernel_length;
+    vec2 points[2 * half + 1];
+    float values[2 * half + 1];
+    vec2 backward[half];
+
+    for (int row = tile->y0; row < tile->y1; row++)
+        for (int column = tile->x0; column < tile->x1; column++)
+        {
+            if (lic->hits[row * lic->width + column] > 0)
+                continue;
+            vec2 seed = vec2_create(column + 0.5, row + 0.5), d;
+            if (!field_grid_direction(grid, seed, &d))
+            {
+                // No field here, the pixel stays blank
+                lic->hits[row * lic->width + column] = -1;
+                continue;
+            }
+            int num_back = trace(grid, tile, lic->kernel_length, seed, -1, half, backward);
+            int n = 0;
+            for (int k = num_back - 1; k >= 0; k--)
+                points[n++] = backward[k];
+            int center = n;
+            points[n++] = seed;
+            n += trace(grid, tile, lic->kernel_length, seed, 1, half, points + n);
+            for (int k = 0; k < n; k++)
+                values[k] = noise_at(lic, points[k]);
+
+            // Running sum over [k - L, k + L], clipped to the streamline
+            int L = lic->kernel_length;
+            int first = fmax(0, center - lic->streamline_length), last = fmin(n - 1, center + lic->streamline_length);
+            float window = 0;
+            int lo = fmax(0, first - L), hi = fmin(n - 1, first + L);
+            for (int k = lo; k <= hi; k++)
+                window += values[k];
+            for (int k = first; k <= last; k++)
+            {
+                int c = points[k].x, r = points[k].y;
+                if (in_tile(tile, points[k]) && lic->hits[r * lic->width + c] >= 0)
+                {
+                    lic->sum[r * lic->width + c] += window / (hi - lo + 1);
+                    lic->hits[r * lic->width + c]++;
+                }
+                // Slide the window to k + 1
+                if (k + L + 1 < n)
+                    window += values[++hi];
+                if (k - L >= 0)
+                {
+                    window -= values[lo];
+                    lo++;
+                }
+            }
+        }
+}
+
+// Draw the LIC texture of the field over the whole screen, white where the
+// field is unknown
+void lic_render(struct gfx_context_t *ctxt, lic_t *lic, field_grid_t *grid)
+{
+    size_t pixels = (size_t)lic->width * lic->height;
+    memset(lic->sum, 0, pixels * sizeof(float));
+    memset(lic->hits, 0, pixels * sizeof(int));
+
+    int tiles_x = (lic->width + LIC_TILE - 1) / LIC_TILE;
+    int tiles_y = (lic->height + LIC_TILE - 1) / LIC_TILE;
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < tiles_x * tiles_y; t++)
+    {
+        tile_t tile;
+        tile.x0 = t % tiles_x * LIC_TILE;
+        tile.y0 = t / tiles_x * LIC_TILE;
+        tile.x1 = fmin(tile.x0 + LIC_TILE, lic->width);
+        tile.y1 = fmin(tile.y0 + LIC_TILE, lic->height);
+        render_tile(lic, grid, &tile);
+    }
+
+    int width = fmin(lic->width, ctxt->width), height = fmin(lic->height, ctxt->height);
+#pragma omp parallel for schedule(static)
+    for (int row = 0; row < height; row++)
+        for (int column = 0; column < width; column++)
+        {
+            int k = row * lic->width + column;
+            float v = lic->hits[k] > 0 ? 0.5f + CONTRAST * (lic->sum[k] / lic->hits[k] - 0.5f) : 1;
+            uint32_t gray = 255 * fminf(1, fmaxf(0, v));
+            ctxt->pixels[row * ctxt->width + column] = MAKE_COLOR(gray, gray, gray);
+        }
+}
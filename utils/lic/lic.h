@@ -0,0 +1,29 @@
+#ifndef _LIC_H_
+#define _LIC_H_
+
+#include <stdint.h>
+#include "../gfx/gfx.h"
+#include "../field_grid/field_grid.h"
+
+#define LIC_TILE 64
+
+// Line integral convolution: white noise smeared along the field lines,
+// computed with FastLIC, one tile per thread
+typedef struct
+{
+    int width;
+    int height;
+    float *noise;
+    float *sum;         // Convolved noise deposited in each pixel
+    int *hits;          // Number of streamlines that deposited in each pixel
+    int kernel_length;  // Half-length of the box filter, in pixels
+    int streamline_length; // Half-length of the streamlines, longer than the filter so that they are reused
+} lic_t;
+
+void lic_init(lic_t *lic, int width, int height, uint64_t seed);
+
+void lic_free(lic_t *lic);
+
+void lic_render(struct gfx_context_t *ctxt, lic_t *lic, field_grid_t *grid);
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <string.h>
+#include "memory.h"
+
+// Keeps arena allocations on their own cache lines, and aligned for SIMD loads
+#define ARENA_ALIGNMENT 64
+
+static long allocation_count = 0;
+
+void *mem_alloc(size_t size)
+{
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+void *mem_calloc(size_t count, size_t size)
+{
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    return calloc(count, size);
+}
+
+void *mem_realloc(void *ptr, size_t size)
+{
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    return realloc(ptr, size);
+}
+
+void mem_free(void *ptr)
+{
+    free(ptr);
+}
+
+// Number of heap allocations made since the start of the program
+long mem_allocation_count()
+{
+    return __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+}
+
+struct _arena_block
+{
+    arena_block_t *next;
+    uint8_t data[];
+};
+
+static size_t align_up(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+void arena_init(arena_t *arena, size_t size)
+{
+    memset(arena, 0, sizeof(arena_t));
+    arena->size = align_up(size);
+    arena->base = aligned_alloc(ARENA_ALIGNMENT, arena->size);
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+}
+
+static void free_blocks(arena_t *arena)
+{
+    while (arena->blocks)
+    {
+        arena_block_t *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+}
+
+void arena_free(arena_t *arena)
+{
+    free_blocks(arena);
+    free(arena->base);
+    memset(arena, 0, sizeof(arena_t));
+}
+
+// Everything allocated since the last reset is released at once
+void arena_reset(arena_t *arena)
+{
+    if (arena->blocks)
+    {
+        free_blocks(arena);
+        free(arena->base);
+        arena->size = align_up(arena->used + arena->spilled);
+        arena->base = aligned_alloc(ARENA_ALIGNMENT, arena->size);
+        __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    }
+    arena->used = 0;
+    arena->spilled = 0;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size = align_up(size);
+    if (arena->used + size <= arena->size)
+    {
+        void *ptr = arena->base + arena->used;
+        arena->used += size;
+        return ptr;
+    }
+
+    arena_block_t *block = aligned_alloc(ARENA_ALIGNMENT, align_up(sizeof(arena_block_t)) + size);
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    if (!block)
+        return NULL;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->spilled += size;
+    return (uint8_t *)block + align_up(sizeof(arena_block_t));
+}
+
+void *arena_calloc(arena_t *arena, size_t count, size_t size)
+{
+    void *ptr = arena_alloc(arena, count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+// A released block stores the index of the next free one in its first bytes
+void pool_init(pool_t *pool, size_t item_size, int capacity)
+{
+    pool->item_size = item_size < sizeof(int) ? sizeof(int) : item_size;
+    pool->capacity = capacity;
+    pool->items = mem_alloc(pool->item_size * capacity);
+    pool->count = 0;
+    pool->free_head = -1;
+}
+
+void pool_free(pool_t *pool)
+{
+    mem_free(pool->items);
+    memset(pool, 0, sizeof(pool_t));
+}
+
+// Returns NULL once the pool is full
+void *pool_alloc(pool_t *pool)
+{
+    if (pool->free_head >= 0)
+    {
+        uint8_t *item = pool->items + pool->free_head * pool->item_size;
+        memcpy(&pool->free_head, item, sizeof(int));
+        return item;
+    }
+    if (pool->count == pool->capacity)
+        return NULL;
+    return pool->items + pool->count++ * pool->item_size;
+}
+
+void pool_release(pool_t *pool, void *item)
+{
+    int index = ((uint8_t *)item - pool->items) / pool->item_size;
+    memcpy(item, &pool->free_head, sizeof(int));
+    pool->free_head = index;
+}
+
+void pool_reset(pool_t *pool)
+{
+    pool->count = 0;
+    pool->free_head = -1;
+}
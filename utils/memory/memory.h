@@ -0,0 +1,65 @@
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every heap allocation of the engine goes through these, so that
+// allocations can be counted
+void *mem_alloc(size_t size);
+
+void *mem_calloc(size_t count, size_t size);
+
+void *mem_realloc(void *ptr, size_t size);
+
+void mem_free(void *ptr);
+
+long mem_allocation_count();
+
+// Bump allocator for per-frame scratch data, reset every frame.
+// Running out of room spills into extra blocks, and the next reset grows
+// the arena to the peak usage so that steady frames never allocate.
+typedef struct _arena_block arena_block_t;
+
+typedef struct
+{
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    size_t spilled;  // Bytes handed out from extra blocks since the last reset
+    arena_block_t *blocks;
+} arena_t;
+
+void arena_init(arena_t *arena, size_t size);
+
+void arena_free(arena_t *arena);
+
+void arena_reset(arena_t *arena);
+
+void *arena_alloc(arena_t *arena, size_t size);
+
+void *arena_calloc(arena_t *arena, size_t count, size_t size);
+
+// Fixed-size blocks allocated out of one fixed buffer, for objects that
+// come and go such as charges and tree nodes.
+// As long as nothing is released, blocks are handed out contiguously.
+typedef struct
+{
+    uint8_t *items;
+    size_t item_size;
+    int capacity;
+    int count;      // Blocks handed out contiguously so far
+    int free_head;  // First released block, -1 if none
+} pool_t;
+
+void pool_init(pool_t *pool, size_t item_size, int capacity);
+
+void pool_free(pool_t *pool);
+
+void *pool_alloc(pool_t *pool);
+
+void pool_release(pool_t *pool, void *item);
+
+void pool_reset(pool_t *pool);
+
+#endif
@@ -0,0 +1,141 @@
+#include "memory.h"
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef struct _test_result
+{
+    bool passed;
+    const char *name;
+} test_result;
+
+typedef test_result (*unit_test_t)(void);
+
+void print_in_color(char *color, char *text)
+{
+    printf("\033%s", color);
+    printf("%s", text);
+    printf("\033[0m");
+}
+void print_in_red(char *text)
+{
+    print_in_color("[0;31m", text);
+}
+void print_in_green(char *text)
+{
+    print_in_color("[0;32m", text);
+}
+
+test_result t_arena_alloc_0()
+{
+    arena_t arena;
+    arena_init(&arena, 1024);
+    bool passed = true;
+    for (int i = 0; i < 8; i++)
+    {
+        void *p = arena_alloc(&arena, 3 + i);
+        if ((uintptr_t)p % 64 != 0)
+            passed = false;
+    }
+    arena_free(&arena);
+
+    return (test_result){.passed = passed,
+                         .name = "Test arena_alloc 0"};
+}
+test_result t_arena_reset_0()
+{
+    arena_t arena;
+    arena_init(&arena, 1024);
+    void *first = arena_alloc(&arena, 100);
+    arena_reset(&arena);
+    long before = mem_allocation_count();
+    void *again = arena_alloc(&arena, 100);
+    bool passed = first == again && mem_allocation_count() == before;
+    arena_free(&arena);
+
+    return (test_result){.passed = passed,
+                         .name = "Test arena_reset 0"};
+}
+test_result t_arena_spill_0()
+{
+    arena_t arena;
+    arena_init(&arena, 128);
+    // The first frame spills, the next ones fit in the grown arena
+    bool passed = true;
+    for (int frame = 0; frame < 3; frame++)
+    {
+        arena_reset(&arena);
+        long before = mem_allocation_count();
+        for (int i = 0; i < 10; i++)
+            if (!arena_calloc(&arena, 100, 1))
+                passed = false;
+        if (frame > 0 && mem_allocation_count() != before)
+            passed = false;
+    }
+    arena_free(&arena);
+
+    return (test_result){.passed = passed,
+                         .name = "Test arena_spill 0"};
+}
+test_result t_pool_alloc_0()
+{
+    pool_t pool;
+    pool_init(&pool, sizeof(double), 4);
+    double *items[5];
+    for (int i = 0; i < 5; i++)
+        items[i] = pool_alloc(&pool);
+    bool passed = items[1] == items[0] + 1 && items[3] == items[0] + 3 && items[4] == NULL;
+    pool_free(&pool);
+
+    return (test_result){.passed = passed,
+                         .name = "Test pool_alloc 0"};
+}
+test_result t_pool_release_0()
+{
+    pool_t pool;
+    pool_init(&pool, sizeof(double), 4);
+    double *a = pool_alloc(&pool);
+    double *b = pool_alloc(&pool);
+    pool_release(&pool, a);
+    pool_release(&pool, b);
+    bool passed = pool_alloc(&pool) == b && pool_alloc(&pool) == a && pool_alloc(&pool) == a + 2;
+    pool_free(&pool);
+
+    return (test_result){.passed = passed,
+                         .name = "Test pool_release 0"};
+}
+//Add or remove your test function name here
+const unit_test_t tests[] = {
+    t_arena_alloc_0,
+    t_arena_reset_0,
+    t_arena_spill_0,
+    t_pool_alloc_0,
+    t_pool_release_0};
+
+int main()
+{
+    uint32_t nb_tests = sizeof(tests) / sizeof(unit_test_t);
+    char message[256];
+    bool all_passed = true;
+
+    for (uint32_t i = 0; i < nb_tests; i++)
+    {
+        printf("Running test n°%d: ...\n", i);
+        test_result r = tests[i]();
+        if (r.passed)
+        {
+            sprintf(message, "\t- %s : OK", r.name);
+            print_in_green(message);
+        }
+        else
+        {
+            all_passed = false;
+            sprintf(message, "\t- %s : FAILED", r.name);
+            print_in_red(message);
+        }
+        printf("\n");
+    }
+    if (all_passed)
+        print_in_green("\nTests suite result : OK\n");
+    else
+        print_in_red("\nTests suite result : FAILED\n");
+}
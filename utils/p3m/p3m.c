@@ -0,0 +1,305 @@
+#include <math.h>
+#include <time.h>
+#include "p3m.h"
+
+#define MIN_MESH 32
+#define MAX_MESH 512
+
+// Charges whose force is compared to the exact one while tuning
+#define TUNING_SAMPLES 64
+
+static const double cutoff_candidates[] = {1.5, 2, 3, 4, 6};
+#define NUM_CUTOFFS (int)(sizeof(cutoff_candidates) / sizeof(cutoff_candidates[0]))
+
+static double seconds_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+p3m_t *p3m_create(double target_error)
+{
+    p3m_t *p3m = mem_calloc(1, sizeof(p3m_t));
+    if (!p3m)
+        return NULL;
+    p3m->target_error = target_error;
+    charge_grid_init(&p3m->grid);
+    return p3m;
+}
+
+void p3m_destroy(p3m_t *p3m)
+{
+    if (p3m->mesh)
+        pic_destroy(p3m->mesh);
+    charge_grid_free(&p3m->grid);
+    mem_free(p3m);
+}
+
+// Region the mesh covers in addition to the charges, or the period of the
+// box. A periodic box expects the charges inside it.
+void p3m_set_box(p3m_t *p3m, double x0, double x1, double y0, double y1)
+{
+    p3m->x0 = x0;
+    p3m->x1 = x1;
+    p3m->y0 = y0;
+    p3m->y1 = y1;
+}
+
+// Switching between an open and a periodic box takes a new tuning
+void p3m_set_periodic(p3m_t *p3m, bool periodic)
+{
+    if (p3m->periodic == periodic)
+        return;
+    p3m->periodic = periodic;
+    if (p3m->mesh)
+        pic_destroy(p3m->mesh);
+    p3m->mesh = NULL;
+    p3m->tuned_count = 0;
+}
+
+// Bring the charges that left the periodic box back in from the other side
+void p3m_wrap(p3m_t *p3m, charge_t *charges, int num_charges)
+{
+    double lx = p3m->x1 - p3m->x0, ly = p3m->y1 - p3m->y0;
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_charges; i++)
+    {
+        charges[i].pos.x -= lx * floor((charges[i].pos.x - p3m->x0) / lx);
+        charges[i].pos.y -= ly * floor((charges[i].pos.y - p3m->y0) / ly);
+    }
+}
+
+// Force of update_charges for a displacement d between two charges, scaled by share
+static vec2 pair_force(vec2 d, double qq, double share)
+{
+    double r2 = fmax(vec2_norm_sqr(d), 1e-3);
+    return vec2_mul(share * K * qq / (r2 * sqrt(r2)), d);
+}
+
+// Short range part of the force and of the potential energy, summed over
+// the cells of the grid in a fixed order. In a periodic box the grid is
+// also searched around the images of the charge next to it, the cutoff
+// being at most half the box each pair is met once, at its nearest image.
+static vec2 short_range_force(p3m_t *p3m, charge_t *charges, int i, double cutoff, double *energy)
+{
+    charge_grid_t *grid = &p3m->grid;
+    int images = p3m->periodic ? 1 : 0;
+    double period_x = p3m->x1 - p3m->x0, period_y = p3m->y1 - p3m->y0;
+
+    vec2 f = vec2_create(0, 0);
+    *energy = 0;
+    for (int sy = -images; sy <= images; sy++)
+        for (int sx = -images; sx <= images; sx++)
+        {
+            vec2 p = vec2_create(charges[i].pos.x + sx * period_x, charges[i].pos.y + sy * period_y);
+            int c0 = fmax(0, floor((p.x - cutoff - grid->origin.x) / grid->cell));
+            int c1 = fmin(grid->width - 1, floor((p.x + cutoff - grid->origin.x) / grid->cell));
+            int r0 = fmax(0, floor((p.y - cutoff - grid->origin.y) / grid->cell));
+            int r1 = fmin(grid->height - 1, floor((p.y + cutoff - grid->origin.y) / grid->cell));
+            // The image is too far from every charge
+            if (p.x + cutoff < grid->origin.x || p.y + cutoff < grid->origin.y ||
+                p.x - cutoff > grid->origin.x + grid->width * grid->cell || p.y - cutoff > grid->origin.y + grid->height * grid->cell)
+                continue;
+
+            for (int r = r0; r <= r1; r++)
+                for (int c = c0; c <= c1; c++)
+                {
+                    int cell = r * grid->width + c;
+                    for (int k = grid->cell_start[cell]; k < grid->cell_start[cell + 1]; k++)
+                    {
+                        int j = grid->indices[k];
+                        if (j == i && sx == 0 && sy == 0)
+                            continue;
+                        vec2 d = vec2_sub(p, charges[j].pos);
+                        double r = vec2_norm(d);
+                        if (r >= cutoff)
+                            continue;
+                        double qq = charges[i].q * charges[j].q;
+                        f = vec2_add(f, pair_force(d, qq, pic_short_range(r, cutoff)));
+                        *energy += K * qq * erfc(3 * r / cutoff) / fmax(r, sqrt(1e-3));
+                    }
+                }
+        }
+    return f;
+}
+
+static void solve_forces(p3m_t *p3m, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy)
+{
+    pic_set_box(p3m->mesh, p3m->x0, p3m->x1, p3m->y0, p3m->y1);
+    pic_forces(p3m->mesh, arena, charges, num_charges, forces, energy);
+    double cutoff = p3m->cutoff_cells * p3m->mesh->cell_x;
+    charge_grid_build(&p3m->grid, charges, num_charges, cutoff);
+
+    double *energies = arena_alloc(arena, num_charges * sizeof(double));
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_charges; i++)
+        forces[i] = vec2_add(forces[i], short_range_force(p3m, charges, i, cutoff, &energies[i]));
+
+    if (energy)
+        for (int i = 0; i < num_charges; i++)
+            *energy += 0.5 * energies[i];
+}
+
+// Forces of update_charges, and the potential energy if energy is not
+// NULL. The solver is tuned again when the number of charges doubled or
+// halved since the last tuning.
+void p3m_forces(void *solver, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy)
+{
+    p3m_t *p3m = solver;
+    if (energy)
+        *energy = 0;
+    if (num_charges == 0)
+        return;
+    if (!p3m->mesh || num_charges > 2 * p3m->tuned_count || 2 * num_charges < p3m->tuned_count)
+        p3m_tune(p3m, charges, num_charges, arena);
+    solve_forces(p3m, arena, charges, num_charges, forces, energy);
+}
+
+// Try every mesh size and cutoff, keep the fastest one within the target
+// error, or the most accurate one if none is
+void p3m_tune(p3m_t *p3m, charge_t *charges, int num_charges, arena_t *arena)
+{
+    p3m->tuned_count = num_charges;
+    if (num_charges == 0)
+        return;
+
+    int stride = fmax(1, num_charges / TUNING_SAMPLES);
+    int num_samples = (num_charges + stride - 1) / stride;
+    vec2 *exact = arena_alloc(arena, num_samples * sizeof(vec2));
+    double exact_sum = 0;
+#pragma omp parallel for schedule(static) reduction(+ : exact_sum)
+    for (int s = 0; s < num_samples; s++)
+    {
+        int i = s * stride;
+        exact[s] = vec2_create(0, 0);
+        if (p3m->periodic)
+            p3m_ewald_reference(p3m, charges, num_charges, i, &exact[s]);
+        else
+            for (int j = 0; j < num_charges; j++)
+                if (j != i)
+                    exact[s] = vec2_add(exact[s], pair_force(vec2_sub(charges[i].pos, charges[j].pos), charges[i].q * charges[j].q, 1));
+        exact_sum += vec2_norm_sqr(exact[s]);
+    }
+
+    // The trials take over p3m->mesh, the previous tuning is done with
+    if (p3m->mesh)
+        pic_destroy(p3m->mesh);
+    p3m->mesh = NULL;
+
+    vec2 *forces = arena_alloc(arena, num_charges * sizeof(vec2));
+    pic_t *best = NULL;
+    double best_cutoff = 0, best_seconds = INFINITY, best_error = INFINITY;
+    p3m->num_trials = 0;
+    p3m->tunings++;
+    for (int size = MIN_MESH; size <= MAX_MESH; size *= 2)
+    {
+        pic_t *mesh = pic_create(PIC_FORCE, p3m->periodic ? PIC_PERIODIC : PIC_OPEN, size, size);
+        bool kept = false;
+        for (int c = 0; c < NUM_CUTOFFS; c++)
+        {
+            // Past half the box, a pair would meet more than one image
+            double cell = fmax(p3m->x1 - p3m->x0, p3m->y1 - p3m->y0) / size;
+            if (p3m->periodic && cutoff_candidates[c] * cell > 0.5 * fmin(p3m->x1 - p3m->x0, p3m->y1 - p3m->y0))
+                continue;
+            pic_set_split(mesh, cutoff_candidates[c]);
+            p3m->mesh = mesh;
+            p3m->cutoff_cells = cutoff_candidates[c];
+            // The first run builds the kernel, the second one is timed
+            solve_forces(p3m, arena, charges, num_charges, forces, NULL);
+            double start = seconds_now();
+            solve_forces(p3m, arena, charges, num_charges, forces, NULL);
+            double seconds = seconds_now() - start;
+
+            double error_sum = 0;
+            for (int s = 0; s < num_samples; s++)
+                error_sum += vec2_norm_sqr(vec2_sub(forces[s * stride], exact[s]));
+            double error = exact_sum > 0 ? sqrt(error_sum / exact_sum) : 0;
+            if (p3m->num_trials < P3M_MAX_TRIALS)
+                p3m->trials[p3m->num_trials++] = (p3m_trial_t){size, cutoff_candidates[c], error, seconds};
+
+            bool accurate = error <= p3m->target_error;
+            bool best_accurate = best_error <= p3m->target_error;
+            if (accurate ? !best_accurate || seconds < best_seconds : !best_accurate && error < best_error)
+            {
+                if (best && best != mesh)
+                    pic_destroy(best);
+                best = mesh;
+                kept = true;
+                best_cutoff = cutoff_candidates[c];
+                best_seconds = seconds;
+                best_error = error;
+            }
+        }
+        if (!kept)
+            pic_destroy(mesh);
+    }
+
+    p3m->mesh = best;
+    pic_set_split(best, best_cutoff);
+    p3m->cutoff_cells = best_cutoff;
+    p3m->seconds = best_seconds;
+    p3m->error = best_error;
+}
+
+// Ewald sum of the force on charge i in the periodic box, to measure the
+// error of the tuning against. The split puts erfc(alpha r) at 1e-8 at
+// half the box so that only the nearest images are summed in real space,
+// and the wave vectors go as far as erfc(k / (2 alpha)) does.
+void p3m_ewald_reference(p3m_t *p3m, charge_t *charges, int num_charges, int i, vec2 *force)
+{
+    double lx = p3m->x1 - p3m->x0, ly = p3m->y1 - p3m->y0;
+    double rc = 0.5 * fmin(lx, ly);
+    double alpha = 4 / rc;
+    vec2 p = charges[i].pos;
+    vec2 f = vec2_create(0, 0);
+    for (int j = 0; j < num_charges; j++)
+    {
+        if (j == i)
+            continue;
+        vec2 d = vec2_sub(p, charges[j].pos);
+        d.x -= lx * round(d.x / lx);
+        d.y -= ly * round(d.y / ly);
+        double r = vec2_norm(d);
+        if (r < rc)
+            f = vec2_add(f, pair_force(d, charges[i].q * charges[j].q, pic_short_range(r, 3 / alpha)));
+    }
+
+    // E(p) = sum over k of G(k) k sum_j qj sin(k.(p - pj)) / area
+    double k_max = 8 * alpha;
+    int nx = ceil(k_max * lx / (2 * M_PI)), ny = ceil(k_max * ly / (2 * M_PI));
+    for (int a = -nx; a <= nx; a++)
+        for (int b = -ny; b <= ny; b++)
+        {
+            double kx = 2 * M_PI * a / lx, ky = 2 * M_PI * b / ly;
+            double k = sqrt(kx * kx + ky * ky);
+            if (k == 0 || k > k_max)
+                continue;
+            double g = 2 * M_PI * K * erfc(k / (2 * alpha)) / (k * lx * ly);
+            double sum = 0;
+            for (int j = 0; j < num_charges; j++)
+                sum += charges[j].q * sin(kx * (p.x - charges[j].pos.x) + ky * (p.y - charges[j].pos.y));
+            f = vec2_add(f, vec2_mul(charges[i].q * g * sum, vec2_create(kx, ky)));
+        }
+    *force = f;
+}
+
+// Error and time of every mesh size and cutoff tried by the last tuning,
+// the kept one marked with a star
+void p3m_print_report(p3m_t *p3m, FILE *out)
+{
+    fprintf(out, "P3M tuning for %d charges, %s box, target error %.2g\n", p3m->tuned_count, p3m->periodic ? "periodic" : "open", p3m->target_error);
+    fprintf(out, "   mesh  cutoff (cells)  alpha        error       ms\n");
+    for (int t = 0; t < p3m->num_trials; t++)
+    {
+        p3m_trial_t *trial = &p3m->trials[t];
+        bool kept = p3m->mesh && trial->mesh == p3m->mesh->width && trial->cutoff_cells == p3m->cutoff_cells;
+        double cell = p3m->periodic ? fmax(p3m->x1 - p3m->x0, p3m->y1 - p3m->y0) / trial->mesh : 0;
+        fprintf(out, "%c %5d  %14.1f  ", kept ? '*' : ' ', trial->mesh, trial->cutoff_cells);
+        if (cell > 0)
+            fprintf(out, "%-9.3g", 3 / (trial->cutoff_cells * cell));
+        else
+            fprintf(out, "%-9s", "-");
+        fprintf(out, "  %9.2e  %7.2f\n", trial->error, 1000 * trial->seconds);
+    }
+}
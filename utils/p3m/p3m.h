@@ -0,0 +1,66 @@
+#ifndef _P3M_H_
+#define _P3M_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../charge_grid/charge_grid.h"
+#include "../memory/memory.h"
+#include "../pic/pic.h"
+
+// Particle-particle particle-mesh solver for the forces of update_charges:
+// the long range part of the force comes from an FFT mesh, the short range
+// part from a direct sum over the charges within the cutoff.
+// The mesh size and the cutoff are tuned for the fastest step meeting the
+// target error, again whenever the number of charges doubled or halved.
+// In a periodic box the mesh sums the long range part over all the images,
+// Ewald style, and the short range part takes the nearest image of each
+// pair.
+
+// One mesh size and cutoff tried by the tuning
+typedef struct
+{
+    int mesh;
+    double cutoff_cells;
+    double error;
+    double seconds;
+} p3m_trial_t;
+
+#define P3M_MAX_TRIALS 32
+
+typedef struct
+{
+    pic_t *mesh;
+    double cutoff_cells; // Cutoff of the short range part, in mesh cells
+    double x0, x1, y0, y1; // Extra region of an open mesh, or the period of the box
+    bool periodic;
+    double target_error; // RMS force error relative to the RMS force
+    int tuned_count;     // Number of charges at the last tuning, 0 if never tuned
+    double error;        // Error measured by the last tuning
+    double seconds;      // Time of one force computation measured by the last tuning
+    charge_grid_t grid;
+    p3m_trial_t trials[P3M_MAX_TRIALS]; // Trials of the last tuning
+    int num_trials;
+    int tunings;         // Number of tunings so far
+} p3m_t;
+
+p3m_t *p3m_create(double target_error);
+
+void p3m_destroy(p3m_t *p3m);
+
+void p3m_set_box(p3m_t *p3m, double x0, double x1, double y0, double y1);
+
+void p3m_set_periodic(p3m_t *p3m, bool periodic);
+
+void p3m_wrap(p3m_t *p3m, charge_t *charges, int num_charges);
+
+void p3m_tune(p3m_t *p3m, charge_t *charges, int num_charges, arena_t *arena);
+
+void p3m_forces(void *p3m, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy);
+
+void p3m_ewald_reference(p3m_t *p3m, charge_t *charges, int num_charges, int i, vec2 *force);
+
+void p3m_print_report(p3m_t *p3m, FILE *out);
+
+#endif
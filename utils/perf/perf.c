@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+#include "perf.h"
+#include "../memory/memory.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char *perf_counter_names[PERF_COUNTER_COUNT] = {"cycles", "instructions", "cache misses", "branch misses", "task ns"};
+
+const char *perf_section_names[PERF_SECTION_COUNT] = {"update", "lines", "render", "charges"};
+
+#ifdef __linux__
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} events[PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+// A counter of the calling thread, user space only so that it works
+// with the default perf_event_paranoid
+static int open_counter(perf_counter_t counter)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[counter].type;
+    attr.config = events[counter].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Value of a counter, scaled up for the time it was multiplexed out
+static uint64_t read_counter(int fd)
+{
+    uint64_t values[3];
+    if (fd < 0 || read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0)
+        return 0;
+    return values[2] == values[1] ? values[0] : (uint64_t)((double)values[0] * values[1] / values[2]);
+}
+#else
+static int open_counter(perf_counter_t counter)
+{
+    (void)counter;
+    return -1;
+}
+
+static uint64_t read_counter(int fd)
+{
+    (void)fd;
+    return 0;
+}
+#endif
+
+// Counters are opened by every thread of the OpenMP team, which the
+// runtime keeps for the next parallel regions of the same size. Returns
+// NULL when no counter at all could be opened.
+perf_t *perf_create(void)
+{
+    perf_t *perf = mem_calloc(1, sizeof(perf_t));
+    if (!perf)
+        return NULL;
+
+#pragma omp parallel
+    {
+        int slot = __atomic_fetch_add(&perf->num_threads, 1, __ATOMIC_RELAXED);
+        if (slot < PERF_MAX_THREADS)
+            for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+                perf->fds[slot][c] = open_counter(c);
+    }
+    if (perf->num_threads > PERF_MAX_THREADS)
+        perf->num_threads = PERF_MAX_THREADS;
+
+    bool any = false;
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        perf->available[c] = true;
+        for (int t = 0; t < perf->num_threads; t++)
+            perf->available[c] &= perf->fds[t][c] >= 0;
+        any |= perf->available[c];
+    }
+    if (!any)
+    {
+        perf_destroy(perf);
+        return NULL;
+    }
+    return perf;
+}
+
+void perf_destroy(perf_t *perf)
+{
+    if (!perf)
+        return;
+#ifdef __linux__
+    for (int t = 0; t < perf->num_threads; t++)
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+            if (perf->fds[t][c] >= 0)
+                close(perf->fds[t][c]);
+#endif
+    mem_free(perf);
+}
+
+// Sum of every counter over the threads
+static void read_all(perf_t *perf, uint64_t counts[PERF_COUNTER_COUNT])
+{
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        counts[c] = 0;
+        if (!perf->available[c])
+            continue;
+        for (int t = 0; t < perf->num_threads; t++)
+            counts[c] += read_counter(perf->fds[t][c]);
+    }
+}
+
+void perf_begin(perf_t *perf, perf_section_t section)
+{
+    if (perf)
+        read_all(perf, perf->start[section]);
+}
+
+void perf_end(perf_t *perf, perf_section_t section)
+{
+    if (!perf)
+        return;
+    uint64_t now[PERF_COUNTER_COUNT];
+    read_all(perf, now);
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+        perf->current[section][c] += now[c] - perf->start[section][c];
+}
+
+void perf_end_frame(perf_t *perf)
+{
+    if (!perf)
+        return;
+    memcpy(perf->last, perf->current, sizeof(perf->last));
+    for (int s = 0; s < PERF_SECTION_COUNT; s++)
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+            perf->total[s][c] += perf->current[s][c];
+    memset(perf->current, 0, sizeof(perf->current));
+    perf->frames++;
+}
+
+// Counts per frame of every section that ran, followed by the
+// instructions per cycle and the misses per thousand instructions when
+// the counters behind them are available. Returns the length written.
+int perf_format(perf_t *perf, const uint64_t counts[PERF_SECTION_COUNT][PERF_COUNTER_COUNT], long frames, char *out, size_t size)
+{
+    if (!perf || frames < 1)
+        return snprintf(out, size, "counters unavailable");
+
+    int n = 0;
+    for (int s = 0; s < PERF_SECTION_COUNT && (size_t)n < size; s++)
+    {
+        const uint64_t *k = counts[s];
+        if (k[PERF_TASK_CLOCK] == 0 && k[PERF_CYCLES] == 0)
+            continue;
+        n += snprintf(out + n, size - n, "%s%s:", n ? ", " : "", perf_section_names[s]);
+        for (int c = 0; c < PERF_COUNTER_COUNT && (size_t)n < size; c++)
+            if (perf->available[c])
+                n += snprintf(out + n, size - n, " %s %.3g", perf_counter_names[c], (double)k[c] / frames);
+        if ((size_t)n < size && perf->available[PERF_CYCLES] && perf->available[PERF_INSTRUCTIONS] && k[PERF_CYCLES])
+            n += snprintf(out + n, size - n, " IPC %.2f", (double)k[PERF_INSTRUCTIONS] / k[PERF_CYCLES]);
+        if (k[PERF_INSTRUCTIONS] == 0)
+            continue;
+        if ((size_t)n < size && perf->available[PERF_CACHE_MISSES])
+            n += snprintf(out + n, size - n, " cache MPKI %.2f", 1000.0 * k[PERF_CACHE_MISSES] / k[PERF_INSTRUCTIONS]);
+        if ((size_t)n < size && perf->available[PERF_BRANCH_MISSES])
+            n += snprintf(out + n, size - n, " branch MPKI %.2f", 1000.0 * k[PERF_BRANCH_MISSES] / k[PERF_INSTRUCTIONS]);
+    }
+    if ((size_t)n >= size)
+        n = size - 1;
+    return n;
+}
@@ -0,0 +1,61 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Hardware counters read through perf_event_open around the hot sections
+// of a frame, on every thread of the OpenMP team. Opt-in: every function
+// accepts a NULL perf_t and does nothing with it.
+
+#define PERF_MAX_THREADS 256
+
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_TASK_CLOCK, // CPU time in ns summed over the threads, a software counter
+    PERF_COUNTER_COUNT
+} perf_counter_t;
+
+typedef enum
+{
+    PERF_SECTION_UPDATE, // Forces and motion of the charges
+    PERF_SECTION_LINES,  // Tracing of the field lines
+    PERF_SECTION_RENDER, // Lines or LIC drawn in the frame
+    PERF_SECTION_CHARGES, // draw_charges and its circles
+    PERF_SECTION_COUNT
+} perf_section_t;
+
+extern const char *perf_counter_names[PERF_COUNTER_COUNT];
+
+extern const char *perf_section_names[PERF_SECTION_COUNT];
+
+typedef struct
+{
+    int num_threads;
+    int fds[PERF_MAX_THREADS][PERF_COUNTER_COUNT]; // -1 where the counter could not be opened
+    bool available[PERF_COUNTER_COUNT];            // Opened on every thread
+    uint64_t start[PERF_SECTION_COUNT][PERF_COUNTER_COUNT];
+    uint64_t current[PERF_SECTION_COUNT][PERF_COUNTER_COUNT]; // Frame in progress
+    uint64_t last[PERF_SECTION_COUNT][PERF_COUNTER_COUNT];    // Last complete frame
+    uint64_t total[PERF_SECTION_COUNT][PERF_COUNTER_COUNT];   // All the complete frames
+    long frames;
+} perf_t;
+
+perf_t *perf_create(void);
+
+void perf_destroy(perf_t *perf);
+
+void perf_begin(perf_t *perf, perf_section_t section);
+
+void perf_end(perf_t *perf, perf_section_t section);
+
+void perf_end_frame(perf_t *perf);
+
+int perf_format(perf_t *perf, const uint64_t counts[PERF_SECTION_COUNT][PERF_COUNTER_COUNT], long frames, char *out, size_t size);
+
+#endif
@@ -0,0 +1,420 @@
+#include <math.h>
+#include <string.h>
+#include "pic.h"
+#include "../fft/fft.h"
+
+pic_t *pic_create(pic_kernel_t kernel, pic_boundary_t boundary, int width, int height)
+{
+    pic_t *pic = mem_calloc(1, sizeof(pic_t));
+    if (!pic)
+        return NULL;
+    pic->kernel = kernel;
+    pic->boundary = boundary;
+    pic->width = width;
+    pic->height = height;
+    // Open boundaries are padded so that the convolution does not wrap around
+    int padding = boundary == PIC_OPEN ? 2 : 1;
+    pic->fft_width = padding * width;
+    pic->fft_height = padding * height;
+    size_t nodes = (size_t)width * height, fft_nodes = (size_t)pic->fft_width * pic->fft_height;
+    pic->chunks = mem_alloc(PIC_CHUNKS * nodes * sizeof(double));
+    pic->work = mem_alloc(fft_nodes * sizeof(double complex));
+    pic->transformed_kernel = mem_alloc(fft_nodes * sizeof(double complex));
+    pic->ex = mem_alloc(nodes * sizeof(double));
+    pic->ey = mem_alloc(nodes * sizeof(double));
+    return pic;
+}
+
+void pic_destroy(pic_t *pic)
+{
+    mem_free(pic->chunks);
+    mem_free(pic->work);
+    mem_free(pic->transformed_kernel);
+    mem_free(pic->ex);
+    mem_free(pic->ey);
+    mem_free(pic->potential_kernel);
+    mem_free(pic->spectrum);
+    mem_free(pic->phi);
+    mem_free(pic);
+}
+
+// An open mesh covers the box and all the charges, a periodic one is the box
+void pic_set_box(pic_t *pic, double x0, double x1, double y0, double y1)
+{
+    pic->x0 = x0;
+    pic->x1 = x1;
+    pic->y0 = y0;
+    pic->y1 = y1;
+}
+
+// Keep only the long range part of the force on the mesh, the part of the
+// pairs closer than cutoff_cells is left to a direct sum
+void pic_set_split(pic_t *pic, double cutoff_cells)
+{
+    if (pic->split != cutoff_cells)
+        pic->kernel_cell_x = pic->kernel_cell_y = 0;
+    pic->split = cutoff_cells;
+}
+
+// Share of the 1/r^2 force left to the short range at distance r, the Ewald
+// split of the Coulomb force, negligible past the cutoff
+double pic_short_range(double r, double cutoff)
+{
+    double x = 3 * r / cutoff;
+    return erfc(x) + 2 * x / sqrt(M_PI) * exp(-x * x);
+}
+
+// Displacement of fft index i, wrapped to the nearest image
+static double kernel_offset(int i, int n)
+{
+    return i < n / 2 ? i : i - n;
+}
+
+// Potential energy of two unit charges at distance d on a PIC_FORCE mesh
+static double potential_kernel(pic_t *pic, vec2 d)
+{
+    double r = vec2_norm(d);
+    if (pic->split > 0)
+    {
+        double alpha = 3 / (pic->split * pic->cell_x);
+        // Limit of erf(alpha r) / r at 0
+        if (r == 0)
+            return K * 2 * alpha / sqrt(M_PI);
+        return K * erf(alpha * r) / fmax(r, sqrt(1e-3));
+    }
+    // No distance is right for two charges in the same cell, half a cell is typical
+    if (r == 0)
+        return K / (0.5 * pic->cell_x);
+    return K / fmax(r, sqrt(1e-3));
+}
+
+// Transform of the long range potential of a unit charge over the periodic
+// box, divided by the cell area: the 2D transform of erf(alpha r) / r is
+// 2 pi erfc(k / (2 alpha)) / k, or 2 pi / k without a split. The k = 0
+// term is dropped, a uniform background keeps the box neutral.
+static double periodic_potential(pic_t *pic, double kx, double ky)
+{
+    double k = sqrt(kx * kx + ky * ky);
+    if (k == 0)
+        return 0;
+    double g = 2 * M_PI * K / k;
+    if (pic->split > 0)
+        g *= erfc(k * pic->split * pic->cell_x / 6);
+    return g / (pic->cell_x * pic->cell_y);
+}
+
+// Wave vector of fft index (i, j)
+static void wave_vector(pic_t *pic, int i, int j, double *kx, double *ky)
+{
+    *kx = 2 * M_PI * kernel_offset(i, pic->fft_width) / (pic->fft_width * pic->cell_x);
+    *ky = 2 * M_PI * kernel_offset(j, pic->fft_height) / (pic->fft_height * pic->cell_y);
+}
+
+static void build_potential_kernel(pic_t *pic)
+{
+    int fw = pic->fft_width, fh = pic->fft_height;
+    if (pic->boundary == PIC_PERIODIC)
+    {
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < fh; j++)
+            for (int i = 0; i < fw; i++)
+            {
+                double kx, ky;
+                wave_vector(pic, i, j, &kx, &ky);
+                pic->potential_kernel[j * fw + i] = periodic_potential(pic, kx, ky);
+            }
+        // The potential of a charge on the nodes around it, own images
+        // included: they only shift the energy by a constant
+        memcpy(pic->spectrum, pic->potential_kernel, (size_t)fw * fh * sizeof(double complex));
+        fft_2d(pic->spectrum, fw, fh, true);
+        pic->self[0] = creal(pic->spectrum[0]);
+        pic->self[1] = creal(pic->spectrum[1]);
+        pic->self[2] = creal(pic->spectrum[fw]);
+        pic->self[3] = creal(pic->spectrum[fw + 1]);
+        return;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < fh; j++)
+        for (int i = 0; i < fw; i++)
+        {
+            vec2 d = vec2_create(kernel_offset(i, fw) * pic->cell_x, kernel_offset(j, fh) * pic->cell_y);
+            pic->potential_kernel[j * fw + i] = potential_kernel(pic, d);
+        }
+    fft_2d(pic->potential_kernel, fw, fh, false);
+
+    // A charge sees its own cloud through these, they are taken out of its energy
+    pic->self[0] = potential_kernel(pic, vec2_create(0, 0));
+    pic->self[1] = potential_kernel(pic, vec2_create(pic->cell_x, 0));
+    pic->self[2] = potential_kernel(pic, vec2_create(0, pic->cell_y));
+    pic->self[3] = potential_kernel(pic, vec2_create(pic->cell_x, pic->cell_y));
+}
+
+// Transform of kernel_x + i kernel_y, so that one inverse transform gives
+// both components of the field in its real and imaginary parts
+static void build_kernel(pic_t *pic)
+{
+    int fw = pic->fft_width, fh = pic->fft_height;
+    double complex *kernel = pic->transformed_kernel;
+
+    if (pic->kernel == PIC_FORCE && pic->boundary == PIC_PERIODIC)
+    {
+        // Ewald sum of the long range part over all the images, the force
+        // is minus the gradient of the potential, i k in Fourier space
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < fh; j++)
+            for (int i = 0; i < fw; i++)
+            {
+                double kx, ky;
+                wave_vector(pic, i, j, &kx, &ky);
+                double g = periodic_potential(pic, kx, ky);
+                if (i == fw / 2)
+                    kx = 0;
+                if (j == fh / 2)
+                    ky = 0;
+                kernel[j * fw + i] = -I * kx * g + ky * g;
+            }
+    }
+    else if (pic->kernel == PIC_FIELD && pic->boundary == PIC_PERIODIC)
+    {
+        // Spectral solution of laplacian(phi) = 2 pi K rho with E = -grad(phi),
+        // rho being the deposited weights over the cell area
+        double area = pic->cell_x * pic->cell_y;
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < fh; j++)
+            for (int i = 0; i < fw; i++)
+            {
+                double kx = 2 * M_PI * kernel_offset(i, fw) / (fw * pic->cell_x);
+                double ky = 2 * M_PI * kernel_offset(j, fh) / (fh * pic->cell_y);
+                double k2 = kx * kx + ky * ky;
+                // The Nyquist modes have no sign, a real field cannot have an odd component there
+                if (i == fw / 2)
+                    kx = 0;
+                if (j == fh / 2)
+                    ky = 0;
+                double complex ex = k2 > 0 ? 2 * M_PI * I * K * kx / (k2 * area) : 0;
+                double complex ey = k2 > 0 ? 2 * M_PI * I * K * ky / (k2 * area) : 0;
+                kernel[j * fw + i] = ex + I * ey;
+            }
+    }
+    else
+    {
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < fh; j++)
+            for (int i = 0; i < fw; i++)
+            {
+                vec2 d = vec2_create(kernel_offset(i, fw) * pic->cell_x, kernel_offset(j, fh) * pic->cell_y);
+                double r2 = vec2_norm_sqr(d);
+                double scale = 0;
+                // The kernel stays odd, so that a charge does not push itself
+                if (r2 > 0 && i != fw / 2 && j != fh / 2)
+                {
+                    if (pic->kernel == PIC_FORCE)
+                    {
+                        scale = K / pow(fmax(r2, 1e-3), 1.5);
+                        if (pic->split > 0)
+                            scale *= 1 - pic_short_range(sqrt(r2), pic->split * pic->cell_x);
+                    }
+                    else
+                    {
+                        scale = -K / r2;
+                    }
+                }
+                kernel[j * fw + i] = scale * d.x + I * scale * d.y;
+            }
+        fft_2d(kernel, fw, fh, false);
+    }
+    if (pic->potential_kernel)
+        build_potential_kernel(pic);
+    pic->kernel_cell_x = pic->cell_x;
+    pic->kernel_cell_y = pic->cell_y;
+}
+
+// Place the mesh over the box and the charges, with square cells of a
+// power of two size so that the kernel is seldom transformed again
+static void fit_open_mesh(pic_t *pic, charge_t *charges, int num_charges)
+{
+    vec2 min = vec2_create(pic->x0, pic->y0), max = vec2_create(pic->x1, pic->y1);
+    for (int i = 0; i < num_charges; i++)
+    {
+        min = vec2_create(fmin(min.x, charges[i].pos.x), fmin(min.y, charges[i].pos.y));
+        max = vec2_create(fmax(max.x, charges[i].pos.x), fmax(max.y, charges[i].pos.y));
+    }
+    // A margin of one cell on each side keeps every charge inside the nodes
+    double needed = fmax((max.x - min.x) / (pic->width - 3), (max.y - min.y) / (pic->height - 3));
+    double cell = pow(2, ceil(log2(fmax(needed, 1e-9))));
+    pic->cell_x = cell;
+    pic->cell_y = cell;
+    pic->origin = vec2_create(floor(min.x / cell) * cell - cell, floor(min.y / cell) * cell - cell);
+}
+
+// Cloud-in-cell: the node below p and its weights along each axis.
+// Returns false if p is not inside the nodes of an open mesh.
+static bool cic(pic_t *pic, vec2 p, int *i, int *j, double *tx, double *ty)
+{
+    double fx = (p.x - pic->origin.x) / pic->cell_x;
+    double fy = (p.y - pic->origin.y) / pic->cell_y;
+    *i = floor(fx);
+    *j = floor(fy);
+    *tx = fx - *i;
+    *ty = fy - *j;
+    if (pic->boundary == PIC_PERIODIC)
+    {
+        *i = ((*i % pic->width) + pic->width) % pic->width;
+        *j = ((*j % pic->height) + pic->height) % pic->height;
+        return true;
+    }
+    return *i >= 0 && *j >= 0 && *i < pic->width - 1 && *j < pic->height - 1;
+}
+
+static void deposit(pic_t *pic, charge_t *charges, int num_charges)
+{
+    int w = pic->width, h = pic->height;
+    size_t nodes = (size_t)w * h;
+
+#pragma omp parallel for schedule(static)
+    for (int c = 0; c < PIC_CHUNKS; c++)
+    {
+        double *grid = pic->chunks + c * nodes;
+        memset(grid, 0, nodes * sizeof(double));
+        for (int k = (long)num_charges * c / PIC_CHUNKS; k < (long)num_charges * (c + 1) / PIC_CHUNKS; k++)
+        {
+            int i, j;
+            double tx, ty;
+            if (!cic(pic, charges[k].pos, &i, &j, &tx, &ty))
+                continue;
+            double weight = pic->kernel == PIC_FORCE ? charges[k].q : 1 / charges[k].q;
+            int i1 = (i + 1) % w, j1 = (j + 1) % h;
+            grid[j * w + i] += weight * (1 - tx) * (1 - ty);
+            grid[j * w + i1] += weight * tx * (1 - ty);
+            grid[j1 * w + i] += weight * (1 - tx) * ty;
+            grid[j1 * w + i1] += weight * tx * ty;
+        }
+    }
+
+    memset(pic->work, 0, (size_t)pic->fft_width * pic->fft_height * sizeof(double complex));
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < h; j++)
+        for (int i = 0; i < w; i++)
+        {
+            double sum = 0;
+            for (int c = 0; c < PIC_CHUNKS; c++)
+                sum += pic->chunks[c * nodes + j * w + i];
+            pic->work[j * pic->fft_width + i] = sum;
+        }
+}
+
+static void solve(pic_t *pic, charge_t *charges, int num_charges, bool potential)
+{
+    if (pic->boundary == PIC_OPEN)
+    {
+        fit_open_mesh(pic, charges, num_charges);
+    }
+    else
+    {
+        pic->origin = vec2_create(pic->x0, pic->y0);
+        pic->cell_x = (pic->x1 - pic->x0) / pic->width;
+        pic->cell_y = (pic->y1 - pic->y0) / pic->height;
+    }
+    int fw = pic->fft_width, fh = pic->fft_height;
+    size_t fft_nodes = (size_t)fw * fh;
+    if (potential && !pic->potential_kernel)
+    {
+        pic->potential_kernel = mem_alloc(fft_nodes * sizeof(double complex));
+        pic->spectrum = mem_alloc(fft_nodes * sizeof(double complex));
+        pic->phi = mem_alloc((size_t)pic->width * pic->height * sizeof(double));
+        pic->kernel_cell_x = pic->kernel_cell_y = 0;
+    }
+    if (pic->cell_x != pic->kernel_cell_x || pic->cell_y != pic->kernel_cell_y)
+        build_kernel(pic);
+
+    deposit(pic, charges, num_charges);
+
+    fft_2d(pic->work, fw, fh, false);
+    if (potential)
+    {
+#pragma omp parallel for schedule(static)
+        for (size_t k = 0; k < fft_nodes; k++)
+            pic->spectrum[k] = pic->work[k] * pic->potential_kernel[k];
+        fft_2d(pic->spectrum, fw, fh, true);
+    }
+#pragma omp parallel for schedule(static)
+    for (size_t k = 0; k < fft_nodes; k++)
+        pic->work[k] *= pic->transformed_kernel[k];
+    fft_2d(pic->work, fw, fh, true);
+
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < pic->height; j++)
+        for (int i = 0; i < pic->width; i++)
+        {
+            pic->ex[j * pic->width + i] = creal(pic->work[j * fw + i]);
+            pic->ey[j * pic->width + i] = cimag(pic->work[j * fw + i]);
+            if (potential)
+                pic->phi[j * pic->width + i] = creal(pic->spectrum[j * fw + i]);
+        }
+    pic->solved = true;
+}
+
+// Field of the charges on the nodes of the mesh
+void pic_solve(pic_t *pic, charge_t *charges, int num_charges)
+{
+    solve(pic, charges, num_charges, false);
+}
+
+// Field at p interpolated from the nodes.
+// Returns false outside of an open mesh.
+bool pic_sample(void *mesh, vec2 p, vec2 *e)
+{
+    pic_t *pic = mesh;
+    int i, j;
+    double tx, ty;
+    if (!pic->solved || !cic(pic, p, &i, &j, &tx, &ty))
+        return false;
+    int w = pic->width;
+    int i1 = (i + 1) % w, j1 = (j + 1) % pic->height;
+    double w00 = (1 - tx) * (1 - ty), w10 = tx * (1 - ty), w01 = (1 - tx) * ty, w11 = tx * ty;
+    e->x = w00 * pic->ex[j * w + i] + w10 * pic->ex[j * w + i1] + w01 * pic->ex[j1 * w + i] + w11 * pic->ex[j1 * w + i1];
+    e->y = w00 * pic->ey[j * w + i] + w10 * pic->ey[j * w + i1] + w01 * pic->ey[j1 * w + i] + w11 * pic->ey[j1 * w + i1];
+    return true;
+}
+
+// Forces of update_charges from a PIC_FORCE mesh, and with energy not NULL
+// the potential energy from a potential mesh solved along
+void pic_forces(void *mesh, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy)
+{
+    pic_t *pic = mesh;
+    solve(pic, charges, num_charges, energy != NULL);
+
+    double *energies = energy ? arena_alloc(arena, num_charges * sizeof(double)) : NULL;
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < num_charges; k++)
+    {
+        vec2 e = vec2_create(0, 0);
+        pic_sample(pic, charges[k].pos, &e);
+        forces[k] = vec2_mul(charges[k].q, e);
+        if (!energies)
+            continue;
+
+        int i, j;
+        double tx, ty;
+        energies[k] = 0;
+        if (!cic(pic, charges[k].pos, &i, &j, &tx, &ty))
+            continue;
+        int w = pic->width;
+        int i1 = (i + 1) % w, j1 = (j + 1) % pic->height;
+        double w00 = (1 - tx) * (1 - ty), w10 = tx * (1 - ty), w01 = (1 - tx) * ty, w11 = tx * ty;
+        double phi = w00 * pic->phi[j * w + i] + w10 * pic->phi[j * w + i1] + w01 * pic->phi[j1 * w + i] + w11 * pic->phi[j1 * w + i1];
+        double self = (w00 * w00 + w10 * w10 + w01 * w01 + w11 * w11) * pic->self[0] +
+                      2 * (w00 * w10 + w01 * w11) * pic->self[1] +
+                      2 * (w00 * w01 + w10 * w11) * pic->self[2] +
+                      2 * (w00 * w11 + w10 * w01) * pic->self[3];
+        energies[k] = 0.5 * charges[k].q * (phi - charges[k].q * self);
+    }
+
+    if (energy)
+    {
+        *energy = 0;
+        for (int k = 0; k < num_charges; k++)
+            *energy += energies[k];
+    }
+}
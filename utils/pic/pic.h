@@ -0,0 +1,73 @@
+#ifndef _PIC_H_
+#define _PIC_H_
+
+#include <stdbool.h>
+#include <complex.h>
+#include "../vec2/vec2.h"
+#include "../charge/charge.h"
+#include "../memory/memory.h"
+
+// Charges are deposited in this many fixed chunks, each on its own grid,
+// summed in chunk order so that the mesh does not depend on the threads
+#define PIC_CHUNKS 16
+
+// What the mesh holds
+typedef enum
+{
+    PIC_FORCE, // Force per unit charge of update_charges, weights q
+    PIC_FIELD  // Field of compute_e, weights 1/q, solved as a Poisson equation
+} pic_kernel_t;
+
+typedef enum
+{
+    PIC_OPEN,    // Zero-padded to twice the size, no images
+    PIC_PERIODIC // The box repeats, charges are wrapped into it
+} pic_boundary_t;
+
+// Particle-mesh solver: charges are deposited on a grid with cloud-in-cell
+// weights, convolved with the kernel through a 2D FFT, and the field on the
+// grid is interpolated back with the same weights
+typedef struct
+{
+    pic_kernel_t kernel;
+    pic_boundary_t boundary;
+    int width; // Nodes of the mesh, powers of two
+    int height;
+    int fft_width;
+    int fft_height;
+    double x0, x1, y0, y1; // Box to cover, the period of a periodic mesh
+    vec2 origin;           // Position of node (0, 0)
+    double cell_x;
+    double cell_y;
+    double split;          // Cutoff in cells of a PIC_FORCE mesh keeping only the long range, 0 for all
+    double kernel_cell_x;  // Cell size the kernel was transformed for, 0 if none
+    double kernel_cell_y;
+    double *chunks;        // PIC_CHUNKS deposit grids
+    double complex *work;
+    double complex *transformed_kernel; // Transform of kernel_x + i kernel_y
+    double *ex;            // Field on the nodes
+    double *ey;
+    double complex *potential_kernel; // Transform of the potential energy kernel, once energy was asked for
+    double complex *spectrum;
+    double *phi;           // Potential on the nodes
+    double self[4];        // Potential kernel at offsets 0, one cell along x, y and the diagonal
+    bool solved;
+} pic_t;
+
+pic_t *pic_create(pic_kernel_t kernel, pic_boundary_t boundary, int width, int height);
+
+void pic_destroy(pic_t *pic);
+
+void pic_set_box(pic_t *pic, double x0, double x1, double y0, double y1);
+
+void pic_set_split(pic_t *pic, double cutoff_cells);
+
+double pic_short_range(double r, double cutoff);
+
+void pic_solve(pic_t *pic, charge_t *charges, int num_charges);
+
+bool pic_sample(void *pic, vec2 p, vec2 *e);
+
+void pic_forces(void *pic, arena_t *arena, charge_t *charges, int num_charges, vec2 *forces, double *energy);
+
+#endif
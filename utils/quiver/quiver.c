@@ -0,0 +1,217 @@
+#include <math.h>
+#include <stdlib.h>
+#include "quiver.h"
+#include "../memory/memory.h"
+
+// Samples per pixel side when the sprites are rasterized
+#define SUPERSAMPLING 4
+
+// Fraction of the arrows drawn at the smallest and at the largest size,
+// the sizes in between split the log of |E| evenly
+#define CLIP_FRACTION 0.02
+#define HISTOGRAM_BINS 256
+
+// Coverage of the arrow at a point of its own frame: u along the arrow
+// from its middle, v across it
+static bool in_arrow(double u, double v, double length, double shaft, double head)
+{
+    double tip = length / 2, base = tip - head;
+    if (u < -tip || u > tip)
+        return false;
+    if (u <= base)
+        return fabs(v) <= shaft / 2;
+    return fabs(v) <= 0.55 * (tip - u);
+}
+
+static void rasterize(quiver_t *quiver, int size, int angle)
+{
+    int side = quiver->spacing;
+    uint8_t *sprite = quiver->atlas + ((size_t)size * QUIVER_ANGLES + angle) * side * side;
+    double theta = 2 * M_PI * angle / QUIVER_ANGLES;
+    double dx = cos(theta), dy = sin(theta);
+    double length = side * (0.35 + 0.6 * size / (QUIVER_SIZES - 1));
+    double shaft = fmax(1, side / 12.0), head = fmin(0.4 * length, side / 3.0);
+    uint8_t *rows = quiver->rows[size][angle];
+    uint8_t *spans = quiver->spans + ((size_t)size * QUIVER_ANGLES + angle) * side * 2;
+    rows[0] = side;
+    rows[1] = 0;
+    for (int row = 0; row < side; row++)
+    {
+        spans[2 * row] = side;
+        spans[2 * row + 1] = 0;
+        for (int column = 0; column < side; column++)
+        {
+            int hits = 0;
+            for (int sy = 0; sy < SUPERSAMPLING; sy++)
+                for (int sx = 0; sx < SUPERSAMPLING; sx++)
+                {
+                    double x = column + (sx + 0.5) / SUPERSAMPLING - side / 2.0;
+                    double y = row + (sy + 0.5) / SUPERSAMPLING - side / 2.0;
+                    hits += in_arrow(x * dx + y * dy, y * dx - x * dy, length, shaft, head);
+                }
+            uint8_t coverage = 255 * hits / (SUPERSAMPLING * SUPERSAMPLING);
+            sprite[row * side + column] = coverage;
+            if (coverage)
+            {
+                spans[2 * row] = column < spans[2 * row] ? column : spans[2 * row];
+                spans[2 * row + 1] = column + 1;
+                rows[0] = row < rows[0] ? row : rows[0];
+                rows[1] = row + 1;
+            }
+        }
+    }
+}
+
+// Arrows spacing pixels apart, at most 255
+void quiver_init(quiver_t *quiver, int spacing)
+{
+    quiver->spacing = spacing;
+    quiver->atlas = mem_alloc((size_t)QUIVER_SIZES * QUIVER_ANGLES * spacing * spacing);
+    quiver->spans = mem_alloc((size_t)QUIVER_SIZES * QUIVER_ANGLES * spacing * 2);
+    for (int size = 0; size < QUIVER_SIZES; size++)
+    {
+        for (int angle = 0; angle < QUIVER_ANGLES; angle++)
+            rasterize(quiver, size, angle);
+        // From blue for the weakest field to red for the strongest
+        double t = (double)size / (QUIVER_SIZES - 1);
+        quiver->colors[size] = MAKE_COLOR((int)(40 + 180 * t), 40, (int)(220 - 180 * t));
+    }
+    quiver->glyphs = NULL;
+    quiver->logs = NULL;
+    quiver->capacity = 0;
+}
+
+void quiver_free(quiver_t *quiver)
+{
+    mem_free(quiver->atlas);
+    mem_free(quiver->spans);
+    mem_free(quiver->glyphs);
+    mem_free(quiver->logs);
+}
+
+// Value below which a fraction of the sorted logs lie, from a histogram
+// of HISTOGRAM_BINS bins between lo and hi
+static float quantile(const int *histogram, int known, double fraction, float lo, float hi)
+{
+    int target = fraction * known, sum = 0;
+    for (int bin = 0; bin < HISTOGRAM_BINS; bin++)
+    {
+        sum += histogram[bin];
+        if (sum > target)
+            return lo + (hi - lo) * (bin + 0.5f) / HISTOGRAM_BINS;
+    }
+    return hi;
+}
+
+// Sprite of every node: the angle of the field rounded to the closest of
+// the atlas, and the log of |E| between the CLIP_FRACTION quantiles of
+// the grid split into the sizes. The quantiles come from a histogram
+// rather than a sort, they only need to be as fine as the sizes.
+static void choose_glyphs(quiver_t *quiver, field_grid_t *grid)
+{
+    int nodes = grid->width * grid->height, known = 0;
+    float min = INFINITY, max = -INFINITY;
+    for (int k = 0; k < nodes; k++)
+        if (grid->magnitude[k] > 0)
+        {
+            float l = quiver->logs[known++] = logf(grid->magnitude[k]);
+            min = fminf(min, l);
+            max = fmaxf(max, l);
+        }
+    int histogram[HISTOGRAM_BINS] = {0};
+    float bins = max > min ? HISTOGRAM_BINS / (max - min) : 0;
+    for (int k = 0; k < known; k++)
+    {
+        int bin = (quiver->logs[k] - min) * bins;
+        histogram[bin < HISTOGRAM_BINS ? bin : HISTOGRAM_BINS - 1]++;
+    }
+    float lo = quantile(histogram, known, CLIP_FRACTION, min, max);
+    float hi = quantile(histogram, known, 1 - CLIP_FRACTION, min, max);
+    float scale = hi > lo ? (QUIVER_SIZES - 1) / (hi - lo) : 0;
+
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < nodes; k++)
+    {
+        if (grid->magnitude[k] <= 0)
+        {
+            quiver->glyphs[k] = QUIVER_NONE;
+            continue;
+        }
+        int size = lrintf((logf(grid->magnitude[k]) - lo) * scale);
+        size = size < 0 ? 0 : size >= QUIVER_SIZES ? QUIVER_SIZES - 1 : size;
+        double theta = atan2(grid->direction[k].y, grid->direction[k].x);
+        int angle = (int)lrint(theta * QUIVER_ANGLES / (2 * M_PI)) & (QUIVER_ANGLES - 1);
+        quiver->glyphs[k] = size * QUIVER_ANGLES + angle;
+    }
+}
+
+// Clears a tile to white and blends in the part of every sprite that
+// falls in it. Sprites are centered on their node and spacing wide, so a
+// tile only looks at the nodes within half a sprite of it.
+static void render_tile(struct gfx_context_t *ctxt, quiver_t *quiver, field_grid_t *grid, int x0, int y0, int x1, int y1)
+{
+    for (int row = y0; row < y1; row++)
+        for (int column = x0; column < x1; column++)
+            ctxt->pixels[row * ctxt->width + column] = COLOR_WHITE;
+
+    int side = quiver->spacing, half = side / 2;
+    double cell = grid->cell;
+    int i0 = fmax(0, floor((x0 - half) / cell)), i1 = fmin(grid->width - 1, ceil((x1 + half) / cell));
+    int j0 = fmax(0, floor((y0 - half) / cell)), j1 = fmin(grid->height - 1, ceil((y1 + half) / cell));
+    for (int j = j0; j <= j1; j++)
+        for (int i = i0; i <= i1; i++)
+        {
+            uint16_t glyph = quiver->glyphs[j * grid->width + i];
+            if (glyph == QUIVER_NONE)
+                continue;
+            int size = glyph / QUIVER_ANGLES, angle = glyph % QUIVER_ANGLES;
+            const uint8_t *sprite = quiver->atlas + (size_t)glyph * side * side;
+            const uint8_t *rows = quiver->rows[size][angle];
+            const uint8_t *spans = quiver->spans + (size_t)glyph * side * 2;
+            int left = (int)lrint(i * cell) - half, top = (int)lrint(j * cell) - half;
+            int r0 = fmax(rows[0], y0 - top), r1 = fmin(rows[1], y1 - top);
+            uint32_t color = quiver->colors[size];
+            uint32_t cr = COLOR_GET_R(color), cg = COLOR_GET_G(color), cb = COLOR_GET_B(color);
+            for (int r = r0; r < r1; r++)
+            {
+                uint32_t *line = ctxt->pixels + (top + r) * ctxt->width + left;
+                int c0 = fmax(spans[2 * r], x0 - left), c1 = fmin(spans[2 * r + 1], x1 - left);
+                for (int c = c0; c < c1; c++)
+                {
+                    uint32_t a = sprite[r * side + c];
+                    if (a == 255)
+                    {
+                        line[c] = color;
+                        continue;
+                    }
+                    uint32_t p = line[c];
+                    line[c] = MAKE_COLOR((COLOR_GET_R(p) * (255 - a) + cr * a) / 255,
+                                         (COLOR_GET_G(p) * (255 - a) + cg * a) / 255,
+                                         (COLOR_GET_B(p) * (255 - a) + cb * a) / 255);
+                }
+            }
+        }
+}
+
+// Draw the arrows of the grid over the whole screen, on white. The grid is
+// expected to be sampled every spacing pixels.
+void quiver_render(struct gfx_context_t *ctxt, quiver_t *quiver, field_grid_t *grid)
+{
+    int nodes = grid->width * grid->height;
+    if (nodes > quiver->capacity)
+    {
+        quiver->glyphs = mem_realloc(quiver->glyphs, nodes * sizeof(uint16_t));
+        quiver->logs = mem_realloc(quiver->logs, nodes * sizeof(float));
+        quiver->capacity = nodes;
+    }
+    choose_glyphs(quiver, grid);
+
+    int tiles_x = (ctxt->width + QUIVER_TILE - 1) / QUIVER_TILE;
+    int tiles_y = (ctxt->height + QUIVER_TILE - 1) / QUIVER_TILE;
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < tiles_x * tiles_y; t++)
+    {
+        int x0 = t % tiles_x * QUIVER_TILE, y0 = t / tiles_x * QUIVER_TILE;
+        render_tile(ctxt, quiver, grid, x0, y0, fmin(x0 + QUIVER_TILE, ctxt->width), fmin(y0 + QUIVER_TILE, ctxt->height));
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef _QUIVER_H_
+#define _QUIVER_H_
+
+#include <stdint.h>
+#include "../gfx/gfx.h"
+#include "../field_grid/field_grid.h"
+
+#define QUIVER_ANGLES 64
+#define QUIVER_SIZES 8
+#define QUIVER_TILE 64
+
+// An arrow on every node of a field grid, pointing along the field, its
+// length and color giving the log of |E|. The arrows are rasterized once
+// for every quantized angle and size into an atlas of antialiased
+// sprites, then blended into the frame one tile per thread.
+typedef struct
+{
+    int spacing;    // Side of a sprite, and pixels between two arrows
+    uint8_t *atlas; // Coverage of the sprites, QUIVER_SIZES x QUIVER_ANGLES of spacing^2 pixels
+    uint8_t rows[QUIVER_SIZES][QUIVER_ANGLES][2]; // Rows of a sprite holding coverage, [first, last)
+    uint8_t *spans;   // Columns of each row of a sprite holding coverage, [first, last)
+    uint32_t colors[QUIVER_SIZES];
+    uint16_t *glyphs; // Sprite of every node of the last grid, QUIVER_NONE where the field is unknown
+    float *logs;      // Scratch for the quantization of the magnitudes
+    int capacity;
+} quiver_t;
+
+#define QUIVER_NONE 0xffff
+
+void quiver_init(quiver_t *quiver, int spacing);
+
+void quiver_free(quiver_t *quiver);
+
+void quiver_render(struct gfx_context_t *ctxt, quiver_t *quiver, field_grid_t *grid);
+
+#endif
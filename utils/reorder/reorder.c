@@ -0,0 +1,145 @@
+#include <math.h>
+#include <string.h>
+#include "reorder.h"
+
+// Positions are quantized to 16 bits per axis over the bounding box
+#define KEY_BITS 16
+// The radix sort splits the items in this many chunks whatever the number
+// of threads, so that the order never depends on the scheduling
+#define RADIX_CHUNKS 16
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+// Spread the 16 low bits of v to the even bits
+static uint32_t spread_bits(uint32_t v)
+{
+    v &= 0xffff;
+    v = (v | v << 8) & 0x00ff00ff;
+    v = (v | v << 4) & 0x0f0f0f0f;
+    v = (v | v << 2) & 0x33333333;
+    v = (v | v << 1) & 0x55555555;
+    return v;
+}
+
+uint32_t morton_key(uint32_t x, uint32_t y)
+{
+    return spread_bits(x) | spread_bits(y) << 1;
+}
+
+// Distance along the Hilbert curve filling the 2^16 x 2^16 square
+uint32_t hilbert_key(uint32_t x, uint32_t y)
+{
+    const uint32_t n = 1u << KEY_BITS;
+    uint32_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant so that the sub-curve starts and ends at the right corners
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            uint32_t t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+// Stable LSD radix sort of items on their high 32 bits, 8 bits a pass.
+// Every chunk counts its digits in parallel, then scatters its items to
+// the offsets of its digits, so the passes are parallel and stable.
+void radix_sort(uint64_t *items, uint64_t *scratch, int n)
+{
+    int counts[RADIX_CHUNKS][RADIX_SIZE];
+    int chunk = (n + RADIX_CHUNKS - 1) / RADIX_CHUNKS;
+
+    for (int shift = 32; shift < 64; shift += RADIX_BITS)
+    {
+#pragma omp parallel for schedule(static)
+        for (int c = 0; c < RADIX_CHUNKS; c++)
+        {
+            memset(counts[c], 0, sizeof(counts[c]));
+            int end = fmin(n, (c + 1) * chunk);
+            for (int i = c * chunk; i < end; i++)
+                counts[c][(items[i] >> shift) & (RADIX_SIZE - 1)]++;
+        }
+
+        // A pass whose digit is the same for all the items moves nothing
+        bool single = false;
+        int offset = 0;
+        for (int d = 0; d < RADIX_SIZE; d++)
+        {
+            int total = 0;
+            for (int c = 0; c < RADIX_CHUNKS; c++)
+            {
+                int k = counts[c][d];
+                counts[c][d] = offset + total;
+                total += k;
+            }
+            single |= total == n;
+            offset += total;
+        }
+        if (single)
+            continue;
+
+#pragma omp parallel for schedule(static)
+        for (int c = 0; c < RADIX_CHUNKS; c++)
+        {
+            int end = fmin(n, (c + 1) * chunk);
+            for (int i = c * chunk; i < end; i++)
+                scratch[counts[c][(items[i] >> shift) & (RADIX_SIZE - 1)]++] = items[i];
+        }
+        memcpy(items, scratch, n * sizeof(uint64_t));
+    }
+}
+
+// Sort the charges along a space-filling curve over their bounding box.
+// Charges with the same key keep their order. When order is not NULL,
+// order[k] is set to the former index of the charge now at k, so that
+// data kept per charge can follow.
+void reorder_charges(charge_t *charges, int num_charges, curve_t curve, arena_t *arena, int *order)
+{
+    if (curve == CURVE_NONE || num_charges < 2)
+    {
+        for (int i = 0; order && i < num_charges; i++)
+            order[i] = i;
+        return;
+    }
+
+    vec2 lo = charges[0].pos, hi = charges[0].pos;
+    for (int i = 1; i < num_charges; i++)
+    {
+        vec2 p = charges[i].pos;
+        lo = vec2_create(fmin(lo.x, p.x), fmin(lo.y, p.y));
+        hi = vec2_create(fmax(hi.x, p.x), fmax(hi.y, p.y));
+    }
+    double size = fmax(hi.x - lo.x, hi.y - lo.y);
+    double scale = size > 0 ? ((1 << KEY_BITS) - 1) / size : 0;
+
+    uint64_t *items = arena_alloc(arena, num_charges * sizeof(uint64_t));
+    uint64_t *scratch = arena_alloc(arena, num_charges * sizeof(uint64_t));
+    charge_t *sorted = arena_alloc(arena, num_charges * sizeof(charge_t));
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_charges; i++)
+    {
+        uint32_t x = (charges[i].pos.x - lo.x) * scale;
+        uint32_t y = (charges[i].pos.y - lo.y) * scale;
+        uint32_t key = curve == CURVE_MORTON ? morton_key(x, y) : hilbert_key(x, y);
+        items[i] = (uint64_t)key << 32 | (uint32_t)i;
+    }
+    radix_sort(items, scratch, num_charges);
+
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < num_charges; k++)
+        sorted[k] = charges[(uint32_t)items[k]];
+    memcpy(charges, sorted, num_charges * sizeof(charge_t));
+    for (int k = 0; order && k < num_charges; k++)
+        order[k] = (uint32_t)items[k];
+}
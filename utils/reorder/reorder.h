@@ -0,0 +1,26 @@
+#ifndef _REORDER_H_
+#define _REORDER_H_
+
+#include <stdint.h>
+#include "../charge/charge.h"
+#include "../memory/memory.h"
+
+// Space-filling curves the charges can be stored along, so that charges
+// close in space are close in memory
+typedef enum
+{
+    CURVE_NONE,
+    CURVE_MORTON,  // Z-order, interleaved bits of x and y
+    CURVE_HILBERT, // No jumps between quadrants, better locality for a few more operations
+    CURVE_COUNT
+} curve_t;
+
+uint32_t morton_key(uint32_t x, uint32_t y);
+
+uint32_t hilbert_key(uint32_t x, uint32_t y);
+
+void radix_sort(uint64_t *items, uint64_t *scratch, int n);
+
+void reorder_charges(charge_t *charges, int num_charges, curve_t curve, arena_t *arena, int *order);
+
+#endif
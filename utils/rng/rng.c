@@ -0,0 +1,73 @@
+#include <math.h>
+#include "rng.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// Ten rounds of the Philox4x32 bijection of counter under key
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// The counter is (block, subsequence low, subsequence high, stream)
+rng_t rng_create(uint64_t seed, rng_stream_t stream, uint64_t subsequence)
+{
+    rng_t rng = {
+        .key = {(uint32_t)seed, (uint32_t)(seed >> 32)},
+        .counter = {0, (uint32_t)subsequence, (uint32_t)(subsequence >> 32), stream},
+        .used = 4};
+    return rng;
+}
+
+uint32_t rng_next_u32(rng_t *rng)
+{
+    if (rng->used == 4)
+    {
+        philox4x32(rng->counter, rng->key, rng->block);
+        rng->counter[0]++;
+        rng->used = 0;
+    }
+    return rng->block[rng->used++];
+}
+
+// Uniform double in [0, 1) with 53 random bits
+double rng_uniform(rng_t *rng)
+{
+    uint64_t hi = rng_next_u32(rng) >> 5;
+    uint64_t lo = rng_next_u32(rng) >> 6;
+    return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+}
+
+double rng_range(rng_t *rng, double lo, double hi)
+{
+    return lo + (hi - lo) * rng_uniform(rng);
+}
+
+// Standard normal number, Box-Muller on two uniform numbers
+double rng_normal(rng_t *rng)
+{
+    double u = 1 - rng_uniform(rng); // In (0, 1], log(u) is finite
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * rng_uniform(rng));
+}
@@ -0,0 +1,39 @@
+#ifndef _RNG_H_
+#define _RNG_H_
+
+#include <stdint.h>
+
+// Streams of the run seed, one per use, so that adding a use of random
+// numbers does not change the numbers drawn by the others
+typedef enum
+{
+    RNG_STREAM_CHARGES,
+    RNG_STREAM_JITTER,
+    RNG_STREAM_THERMOSTAT,
+    RNG_STREAM_LIC
+} rng_stream_t;
+
+// Philox4x32-10 counter-based generator.
+// The numbers only depend on (seed, stream, subsequence) and on how many
+// were drawn, never on which thread draws them or in what order.
+typedef struct
+{
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    int used; // Numbers of the block already handed out
+} rng_t;
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+
+rng_t rng_create(uint64_t seed, rng_stream_t stream, uint64_t subsequence);
+
+uint32_t rng_next_u32(rng_t *rng);
+
+double rng_uniform(rng_t *rng);
+
+double rng_range(rng_t *rng, double lo, double hi);
+
+double rng_normal(rng_t *rng);
+
+#endif
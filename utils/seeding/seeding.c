@@ -0,0 +1,51 @@
+#include <math.h>
+#include "seeding.h"
+
+// Seeds on a regular grid of precision x precision points over [x0,x1]x[y0,y1].
+// Each one is traced in both directions.
+// Returns the number of seeds written.
+int seeding_grid(int precision, double x0, double x1, double y0, double y1, field_seed_t *seeds)
+{
+    double vertical_unit = (y1 - y0) / precision;
+    double horizontal_unit = (x1 - x0) / precision;
+    for (int y = 0; y < precision; y++)
+        for (int x = 0; x < precision; x++)
+            seeds[y * precision + x] = (field_seed_t){vec2_create(x0 + horizontal_unit * x, y0 + vertical_unit * y), 0};
+    return precision * precision;
+}
+
+// The flux leaving a charge is proportional to |q|, and so is its number of lines
+static int lines_of_charge(charge_t c, double lines_per_unit)
+{
+    return fmax(1, round(lines_per_unit * fabs(c.q)));
+}
+
+// Number of seeds seeding_flux writes for these charges
+int seeding_flux_count(charge_t *charges, int num_charges, double lines_per_unit)
+{
+    int n = 0;
+    for (int i = 0; i < num_charges; i++)
+        n += lines_of_charge(charges[i], lines_per_unit);
+    return n;
+}
+
+// Seeds spread evenly on a circle of the given radius around each charge,
+// lines_per_unit * |q| of them, traced away from the charge with a step dx.
+// Returns the number of seeds written.
+int seeding_flux(charge_t *charges, int num_charges, double lines_per_unit, double radius, double dx, field_seed_t *seeds)
+{
+    int n = 0;
+    for (int i = 0; i < num_charges; i++)
+    {
+        int count = lines_of_charge(charges[i], lines_per_unit);
+        // compute_e points towards positive charges, so they are left against the field
+        double outward_dx = charges[i].q > 0 ? -fabs(dx) : fabs(dx);
+        for (int k = 0; k < count; k++)
+        {
+            double angle = 2 * M_PI * (k + 0.5) / count;
+            vec2 offset = vec2_create(radius * cos(angle), radius * sin(angle));
+            seeds[n++] = (field_seed_t){vec2_add(charges[i].pos, offset), outward_dx};
+        }
+    }
+    return n;
+}
@@ -0,0 +1,13 @@
+#ifndef _SEEDING_H_
+#define _SEEDING_H_
+
+#include "../charge/charge.h"
+#include "../field_lines/field_lines.h"
+
+int seeding_grid(int precision, double x0, double x1, double y0, double y1, field_seed_t *seeds);
+
+int seeding_flux_count(charge_t *charges, int num_charges, double lines_per_unit);
+
+int seeding_flux(charge_t *charges, int num_charges, double lines_per_unit, double radius, double dx, field_seed_t *seeds);
+
+#endif